@@ -0,0 +1,271 @@
+#pragma once
+#include "checked_varint_parser.h"
+#include "num_varints.h"
+#include "varint_parser.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+// Varints in [begin, end) by encoded length, counted 64 bytes at a time from
+// the continuation bit masks like num_varints does. A varint is counted in the
+// block it starts in; one cut off by end is counted by the bytes it has.
+struct varint_length_histogram {
+  static constexpr int max_length = 10;
+  // counts[i] is the number of varints of i + 1 bytes
+  std::array<std::size_t, max_length> counts{};
+
+  varint_length_histogram() = default;
+
+  varint_length_histogram(const char *begin, const char *end) {
+    const auto masks = [&](const char *p) -> uint64_t {
+      if (end - p >= 64)
+        return varint_block_masks(p, 0x7f).cont;
+      alignas(64) char padded[64] = {};
+      memcpy(padded, p, std::max<std::ptrdiff_t>(end - p, 0));
+      return varint_block_masks(padded, 0x7f).cont;
+    };
+
+    // at_least[i] counts the varints of more than i bytes
+    std::array<std::size_t, max_length> at_least{};
+    uint64_t cont = masks(begin);
+    bool carry = true; // the previous byte ended a varint
+    for (const char *p = begin; p < end; p += 64) {
+      const uint64_t valid = end - p >= 64 ? ~0ULL : (1ULL << (end - p)) - 1;
+      const uint64_t next = masks(p + 64);
+      // the masks of the next block in the high 64 bits, so runs of
+      // continuation bytes can be followed across the block boundary
+      const auto x = (static_cast<unsigned __int128>(next) << 64) | cont;
+      const uint64_t starts = ((~cont << 1) | carry) & valid;
+      // bit j of runs is set when bytes j to j + i - 1 all continue
+      unsigned __int128 runs = ~static_cast<unsigned __int128>(0);
+      for (int i = 0; i < max_length; ++i) {
+        at_least[i] += std::popcount(starts & static_cast<uint64_t>(runs));
+        runs &= x >> i;
+      }
+      carry = (cont >> 63) == 0;
+      cont = next;
+    }
+    for (int i = 0; i < max_length; ++i)
+      counts[i] = at_least[i] - (i + 1 < max_length ? at_least[i + 1] : 0);
+  }
+
+  // number of varints ending in [begin, end)
+  static std::size_t count(const char *begin, const char *end) { return num_varints({begin, end}); }
+
+  std::size_t total() const {
+    std::size_t n = 0;
+    for (auto c : counts)
+      n += c;
+    return n;
+  }
+};
+
+// Bulk kernels the adaptive parser picks from, as far as the target has them.
+enum class varint_kernel : int {
+  ubfx,
+  bmi,
+  masked_vbyte,
+};
+
+inline constexpr int num_varint_kernels = 3;
+
+inline constexpr bool varint_kernel_available(varint_kernel k) {
+  switch (k) {
+  case varint_kernel::ubfx:
+    return true;
+  case varint_kernel::bmi:
+#ifdef __BMI2__
+    return true;
+#else
+    return false;
+#endif
+  case varint_kernel::masked_vbyte:
+#ifdef __AVX2__
+    return true;
+#else
+    return false;
+#endif
+  }
+  return false;
+}
+
+template <typename T>
+const char *parse_with_kernel(varint_kernel k, const char *begin, const char *end, T *result) {
+  switch (k) {
+#ifdef __BMI2__
+  case varint_kernel::bmi: {
+    bmi_varint_parser<6, T> parser;
+    return parser.parse(begin, end, result);
+  }
+#endif
+#ifdef __AVX2__
+  case varint_kernel::masked_vbyte:
+    return masked_vbyte_parser<32>::parse(begin, end, result);
+#endif
+  default:
+    return ubfx_varint_parser::parse(begin, end, result);
+  }
+}
+
+// Calibrated cost model of the kernels: nanoseconds per varint for each
+// shape of input. The cost of a kernel doesn't add up over lengths: it depends
+// on which lengths mix and on how predictable they are. A shape is coarse, so
+// the same few come up on varied data: the mean length in half bytes from 1
+// byte to 4.5 and more, and how many of the varints have 5 bytes or more
+// (none, under 1/16, under 1/4, more). The model times every kernel on every
+// shape once, when it's constructed, on varints whose lengths are drawn
+// independently from the shape so the branch predictor can't learn them;
+// parsing only looks the choice up.
+class varint_cost_model {
+public:
+  using costs = std::array<double, num_varint_kernels>;
+  static constexpr int mean_buckets = 8;
+  static constexpr int long_buckets = 4;
+  static constexpr int num_shapes = mean_buckets * long_buckets;
+
+private:
+  static constexpr int max_length = varint_length_histogram::max_length;
+  std::array<costs, num_shapes> table;
+  std::array<varint_kernel, num_shapes> best;
+
+  // count varints of shape: long ones of 5 to 10 bytes, and short ones of the
+  // two lengths around the mean that makes up the rest
+  static costs measure(int shape, std::size_t count, int repetitions) {
+    constexpr double long_share[long_buckets] = {0, 1.0 / 32, 1.0 / 8, 1.0 / 2};
+    const double share = long_share[shape % long_buckets];
+    const double mean = 1.25 + 0.5 * (shape / long_buckets);
+    // 7.5 bytes is the mean of the long varints
+    const double short_mean = std::clamp((mean - share * 7.5) / (1 - share), 1.0, 4.0);
+    const int short_length = std::min(static_cast<int>(short_mean), 3);
+    const double longer = short_mean - short_length;
+
+    std::vector<char> data(count * max_length);
+    std::vector<uint64_t> result(count);
+    char *end = data.data();
+    uint64_t x = 0x9e3779b97f4a7c15ULL;
+    for (std::size_t i = 0; i < count; ++i) {
+      x ^= x << 13;
+      x ^= x >> 7;
+      x ^= x << 17;
+      const double u = (x >> 11) * 0x1p-53;
+      int length;
+      if (u < share)
+        length = 5 + static_cast<int>(x % 6);
+      else
+        length = short_length + ((u - share) / (1 - share) < longer);
+      const int low_bits = 7 * (length - 1);
+      uint64_t v = low_bits >= 63 ? x | (1ULL << 63) : (1ULL << low_bits) | (x & ((1ULL << low_bits) - 1));
+      for (; v >= 0x80; v >>= 7)
+        *end++ = char(v | 0x80);
+      *end++ = char(v);
+    }
+
+    costs c;
+    for (int k = 0; k < num_varint_kernels; ++k) {
+      c[k] = std::numeric_limits<double>::infinity();
+      if (!varint_kernel_available(static_cast<varint_kernel>(k)))
+        continue;
+      // the first run warms up the caches and the clock frequency
+      for (int r = 0; r <= repetitions; ++r) {
+        const auto start = std::chrono::steady_clock::now();
+        parse_with_kernel(static_cast<varint_kernel>(k), data.data(), end, result.data());
+        const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+        if (r > 0)
+          c[k] = std::min(c[k], elapsed.count() / count);
+      }
+    }
+    return c;
+  }
+
+public:
+  // The defaults take about 15 ms.
+  explicit varint_cost_model(std::size_t count = 1 << 12, int repetitions = 3) {
+    for (int shape = 0; shape < num_shapes; ++shape) {
+      table[shape] = measure(shape, count, repetitions);
+      best[shape] = static_cast<varint_kernel>(std::min_element(table[shape].begin(), table[shape].end()) -
+                                               table[shape].begin());
+    }
+  }
+
+  static int shape_of(const varint_length_histogram &h) {
+    const std::size_t n = h.total();
+    if (n == 0)
+      return 0;
+    std::size_t bytes = 0, long_varints = 0;
+    for (int i = 0; i < max_length; ++i) {
+      bytes += (i + 1) * h.counts[i];
+      if (i >= 4)
+        long_varints += h.counts[i];
+    }
+    const int mean = static_cast<int>(std::min<std::size_t>(2 * (bytes - n) / n, mean_buckets - 1));
+    const int share = long_varints == 0 ? 0 : long_varints * 16 < n ? 1 : long_varints * 4 < n ? 2 : 3;
+    return mean * long_buckets + share;
+  }
+
+  // the costs of the kernels for a shape; unavailable kernels cost infinity
+  const costs &costs_of(int shape) const { return table[shape]; }
+
+  varint_kernel choose(int shape) const { return best[shape]; }
+
+  static varint_cost_model &get() {
+    static varint_cost_model model;
+    return model;
+  }
+};
+
+// Front end that decodes each buffer with the kernel the cost model predicts
+// to be fastest for it. The kernel is chosen from the length histogram of the
+// first sample_bytes and chosen again every resample_bytes, so long streams
+// whose shape changes keep running at the best throughput for each part. The
+// model is calibrated when the parser is constructed, if it hasn't been.
+template <typename T = uint64_t>
+class adaptive_varint_parser {
+  const varint_cost_model &model;
+  varint_kernel last = varint_kernel::ubfx;
+
+public:
+  static constexpr std::ptrdiff_t min_sample_bytes = 64;
+  static constexpr std::ptrdiff_t sample_bytes = 1024;
+  static constexpr std::ptrdiff_t resample_bytes = 64 << 10;
+
+  explicit adaptive_varint_parser(const varint_cost_model &model = varint_cost_model::get()) : model(model) {}
+
+  // the kernel chosen for the last part of the last buffer
+  varint_kernel kernel() const { return last; }
+
+  // Same contract as the kernels: decodes the varints in [begin, end), which
+  // must end with a complete varint, and returns end.
+  const char *parse(const char *begin, const char *end, T *result) {
+    while (begin < end) {
+      const char *part_end = end;
+      std::size_t count = 0;
+      if (end - begin > resample_bytes) {
+        // cut after the last varint ending in the next resample_bytes
+        part_end = begin + resample_bytes;
+        while (part_end > begin && int8_t(part_end[-1]) < 0)
+          --part_end;
+        if (part_end == begin)
+          part_end = end;
+      }
+      // buffers too short to sample go to the kernel chosen last
+      if (part_end - begin >= min_sample_bytes) {
+        const auto sample = varint_length_histogram(begin, std::min(part_end, begin + sample_bytes));
+        last = model.choose(varint_cost_model::shape_of(sample));
+      }
+      if (part_end != end)
+        count = varint_length_histogram::count(begin, part_end);
+      auto r = parse_with_kernel(last, begin, part_end, result);
+      if (r != part_end) [[unlikely]]
+        return r;
+      result += count;
+      begin = part_end;
+    }
+    return begin;
+  }
+};
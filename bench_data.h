@@ -0,0 +1,175 @@
+#pragma once
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <numeric>
+#include <random>
+#include <utility>
+#include <vector>
+
+// Values shared by the decoder and encoder benchmarks, drawn from named
+// distributions. Everything is generated from a fixed seed with the raw output
+// of std::mt19937_64, whose sequence the standard specifies, so runs are
+// reproducible across machines and standard libraries.
+enum class value_distribution : int {
+  uniform,        // uniform below 2^28: almost all 4-byte varints
+  one_byte,       // below 2^7
+  geometric,      // encoded lengths of 1 to 10 bytes, each half as likely as the previous
+  zipf,           // Zipf-like (s = 1) below 2^20: mostly 1 and 2 bytes
+  timestamps,     // gaps between sorted timestamps, as delta coding stores them
+  negative_int32, // int32 values, 1 in 8 negative and sign-extended to 10 bytes
+  mixed,          // lengths of 1 to 10 bytes in random order, to defeat branch prediction
+  trace,          // replay of the varints captured in the file named by VARINT_TRACE
+};
+
+struct value_distribution_info {
+  const char *name;
+  // every value fits in int32_t, and in uint32_t unless negative
+  bool int32;
+  bool negative;
+};
+
+inline constexpr value_distribution_info value_distributions[] = {
+    {"uniform", true, false},  {"one_byte", true, false},      {"geometric", false, false},
+    {"zipf", true, false},     {"timestamps", true, false},    {"negative_int32", true, true},
+    {"mixed", false, false},   {"trace", false, false},
+};
+
+// the varints of the VARINT_TRACE file, decoded; empty when it isn't set
+inline const std::vector<uint64_t> &get_trace_values() {
+  static const std::vector<uint64_t> values = [] {
+    std::vector<uint64_t> values;
+    const char *path = std::getenv("VARINT_TRACE");
+    if (path == nullptr)
+      return values;
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+      std::fprintf(stderr, "cannot open VARINT_TRACE file %s\n", path);
+      std::exit(1);
+    }
+    uint64_t v = 0;
+    int shift = 0;
+    for (auto it = std::istreambuf_iterator<char>(file); it != std::istreambuf_iterator<char>(); ++it) {
+      const uint64_t byte = uint8_t(*it);
+      if (shift < 64)
+        v |= (byte & 0x7f) << shift;
+      shift += 7;
+      if (byte < 0x80) {
+        values.push_back(v);
+        v = 0;
+        shift = 0;
+      }
+    }
+    return values;
+  }();
+  return values;
+}
+
+inline std::vector<uint64_t> make_values(std::size_t len, value_distribution dist) {
+  std::mt19937_64 engine(0x5eed + static_cast<int>(dist));
+  // uniform in [0, 1)
+  const auto unit = [&] { return static_cast<double>(engine() >> 11) * 0x1p-53; };
+  // a value taking exactly bytes bytes
+  const auto of_length = [&](int bytes) {
+    const int bits = std::min(7 * bytes, 64);
+    const uint64_t low = engine() & (bits == 64 ? ~0ULL : (1ULL << bits) - 1);
+    return bytes == 1 ? low : low | (1ULL << (7 * (bytes - 1)));
+  };
+
+  std::vector<uint64_t> values(len);
+  if (dist == value_distribution::trace) {
+    auto &trace = get_trace_values();
+    for (std::size_t i = 0; i < len && !trace.empty(); ++i)
+      values[i] = trace[i % trace.size()];
+    return values;
+  }
+  for (auto &v : values) {
+    switch (dist) {
+    case value_distribution::uniform:
+      v = engine() % (1ULL << 28);
+      break;
+    case value_distribution::one_byte:
+      v = engine() & 0x7f;
+      break;
+    case value_distribution::geometric:
+      v = of_length(std::min(std::countr_zero(engine()) + 1, 10));
+      break;
+    case value_distribution::zipf:
+      // inverse transform of the density 1 / x over [1, 2^20)
+      v = static_cast<uint64_t>(std::exp2(20 * unit())) - 1;
+      break;
+    case value_distribution::timestamps:
+      // geometric gaps with a mean of 128, mostly 1 or 2 bytes
+      v = static_cast<uint64_t>(std::log(1 - unit()) / std::log(1 - 1.0 / 128));
+      break;
+    case value_distribution::negative_int32: {
+      const auto r = engine();
+      const auto magnitude = static_cast<int64_t>(r % (1ULL << 28));
+      v = static_cast<uint64_t>((r >> 61) == 0 ? -magnitude : magnitude);
+      break;
+    }
+    case value_distribution::mixed:
+      v = of_length(static_cast<int>(engine() % 10) + 1);
+      break;
+    case value_distribution::trace:
+      break;
+    }
+  }
+  return values;
+}
+
+inline const std::vector<uint64_t> &get_values(std::size_t len, value_distribution dist) {
+  static std::map<std::pair<std::size_t, value_distribution>, std::vector<uint64_t>> all_values;
+  auto &values = all_values[{len, dist}];
+  if (values.size() == 0)
+    values = make_values(len, dist);
+  return values;
+}
+
+// Running sums of the values, like timestamps or posting lists; the values are
+// the gaps their delta coding stores.
+inline const std::vector<uint64_t> &get_sorted_values(std::size_t len, value_distribution dist) {
+  static std::map<std::pair<std::size_t, value_distribution>, std::vector<uint64_t>> all_values;
+  auto &values = all_values[{len, dist}];
+  if (values.size() == 0) {
+    auto &gaps = get_values(len, dist);
+    values.resize(len);
+    std::inclusive_scan(gaps.begin(), gaps.end(), values.begin());
+  }
+  return values;
+}
+
+// The benchmarks take the value count as range(0) and the distribution as
+// range(1), and are labeled with its name.
+inline value_distribution bench_distribution(benchmark::State &state) {
+  const auto dist = static_cast<value_distribution>(state.range(1));
+  state.SetLabel(value_distributions[state.range(1)].name);
+  return dist;
+}
+
+// Registers the usual counts for every distribution; the trace one only when
+// VARINT_TRACE is set.
+template <bool Int32 = false, bool Negative = true>
+void distribution_args(benchmark::internal::Benchmark *b) {
+  for (int d = 0; d < static_cast<int>(std::size(value_distributions)); ++d) {
+    const auto &info = value_distributions[d];
+    if ((Int32 && !info.int32) || (!Negative && info.negative))
+      continue;
+    if (static_cast<value_distribution>(d) == value_distribution::trace && std::getenv("VARINT_TRACE") == nullptr)
+      continue;
+    for (int count : {10, 100, 300, 1000})
+      b->Args({count, d});
+  }
+}
+
+// for benchmarks on 32-bit values, signed or not
+inline void int32_distribution_args(benchmark::internal::Benchmark *b) { distribution_args<true>(b); }
+inline void uint32_distribution_args(benchmark::internal::Benchmark *b) { distribution_args<true, false>(b); }
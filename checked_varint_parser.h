@@ -0,0 +1,212 @@
+#pragma once
+#include "varint_parser.h"
+
+#include <bit>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <system_error>
+#include <type_traits>
+
+// Result of the checked parsers, in the manner of std::from_chars_result: ptr
+// is the end of the decoded input on success, or the first byte of the
+// offending varint with ec set to
+//   - std::errc::invalid_argument when the input ends inside a varint;
+//   - std::errc::value_too_large for varints longer than 10 bytes;
+//   - std::errc::result_out_of_range when the value doesn't fit in the output
+//     type. Signed 32-bit and narrower types accept both the sign-extended
+//     10-byte encoding of negative values and the encoding of their unsigned
+//     counterpart.
+// Values before ptr have been written to the output.
+struct varint_parse_result {
+  const char *ptr;
+  std::errc ec;
+};
+
+template <typename T>
+constexpr bool varint_value_fits(uint64_t v) {
+  if constexpr (sizeof(T) == sizeof(uint64_t)) {
+    return true;
+  } else {
+    if (v <= std::numeric_limits<std::make_unsigned_t<T>>::max())
+      return true;
+    return std::is_signed_v<T> && static_cast<int64_t>(v) < 0 &&
+           static_cast<int64_t>(v) >= std::numeric_limits<T>::min();
+  }
+}
+
+template <typename T>
+constexpr varint_parse_result parse_checked_varint(const char *p, const char *end, T &value) {
+  uint64_t v = 0;
+  for (int i = 0; i < 10; ++i) {
+    if (p + i == end)
+      return {p, std::errc::invalid_argument};
+    uint64_t next_byte = uint8_t(p[i]);
+    v |= (next_byte & 0x7f) << ((CHAR_BIT - 1) * i);
+    if (next_byte < 0x80) {
+      if ((i == 9 && next_byte > 1) || !varint_value_fits<T>(v))
+        return {p, std::errc::result_out_of_range};
+      value = static_cast<T>(v);
+      return {p + i + 1, {}};
+    }
+  }
+  return {p, std::errc::value_too_large};
+}
+
+// Bit i of cont is set when byte i of a 64 byte block has its continuation bit
+// set; bit i of big is set when byte i is a terminator greater than threshold.
+struct varint_block_masks {
+  uint64_t cont;
+  uint64_t big;
+
+  varint_block_masks(const char *p, uint8_t threshold) {
+#if defined(__AVX512BW__)
+    const __m512i v = _mm512_loadu_si512(p);
+    cont = _mm512_movepi8_mask(v);
+    big = _mm512_cmpgt_epi8_mask(v, _mm512_set1_epi8(char(threshold)));
+#elif defined(__AVX2__)
+    cont = big = 0;
+    for (int i = 0; i < 64; i += 32) {
+      const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + i));
+      cont |= uint64_t(uint32_t(_mm256_movemask_epi8(v))) << i;
+      big |= uint64_t(uint32_t(_mm256_movemask_epi8(
+                 _mm256_cmpgt_epi8(v, _mm256_set1_epi8(char(threshold)))))) << i;
+    }
+#else
+    cont = big = 0;
+    for (int i = 0; i < 64; i += 8) {
+      uint64_t word;
+      memcpy(&word, p + i, sizeof(word));
+      // gathers the top bit of every byte into the top byte
+      constexpr uint64_t gather = 0x0002040810204081ULL;
+      const uint64_t high = 0x8080808080808080ULL;
+      const uint64_t over = ((word & ~high) + 0x0101010101010101ULL * (0x7f - threshold)) & ~word & high;
+      cont |= (((word & high) * gather) >> 56) << i;
+      big |= ((over * gather) >> 56) << i;
+    }
+#endif
+  }
+};
+
+// Bulk parser for untrusted input. A vectorized pass over segments small
+// enough to stay in L1 flags varints that may be too long or out of range;
+// everything before them is decoded by the unchecked Parse kernel and only the
+// flagged varints go through the scalar checks of parse_checked_varint().
+template <typename T, auto Parse = &ubfx_varint_parser::parse<T>>
+struct checked_varint_parser {
+  static constexpr int max_bytes = varint_max_size<T>;
+  // largest last byte of a max_bytes long varint
+  static constexpr uint8_t last_byte_max =
+      (1U << (sizeof(T) * CHAR_BIT - (CHAR_BIT - 1) * (max_bytes - 1))) - 1;
+  static constexpr std::ptrdiff_t segment_size = 4096;
+
+  // bit i is set when bytes i - K + 1 to i all have the continuation bit set;
+  // x holds the masks of the current block in the high and the previous block
+  // in the low 64 bits
+  template <int K>
+  static inline unsigned __int128 continuation_runs(unsigned __int128 x) {
+    if constexpr (K == 1) {
+      return x;
+    } else if constexpr (K % 2 == 0) {
+      auto half = continuation_runs<K / 2>(x);
+      return half & (half << (K / 2));
+    } else {
+      return continuation_runs<K - 1>(x) & (x << (K - 1));
+    }
+  }
+
+  struct block_scan {
+    // continuation bits of the block
+    uint64_t cont;
+    // the bytes of the block before end
+    uint64_t valid;
+    // bytes ending a run of max_bytes continuation bytes, or ending a
+    // max_bytes long varint with a last byte over last_byte_max
+    uint64_t suspicious;
+  };
+
+  // Scans the 64 bytes at q, zero padded past end. prev_cont holds the
+  // continuation bits of the previous block and is updated to those of this
+  // one.
+  static block_scan scan_block(const char *q, const char *end, uint64_t &prev_cont) {
+    uint64_t valid = ~0ULL;
+    const char *block = q;
+    alignas(64) char padded[64];
+    if (end - q < 64) {
+      valid = (1ULL << (end - q)) - 1;
+      memset(padded, 0, sizeof(padded));
+      memcpy(padded, q, end - q);
+      block = padded;
+    }
+    const varint_block_masks masks(block, last_byte_max);
+    const auto cont = (static_cast<unsigned __int128>(masks.cont) << 64) | prev_cont;
+    const uint64_t too_long = continuation_runs<max_bytes>(cont) >> 64;
+    const uint64_t last_byte = (continuation_runs<max_bytes - 1>(cont) << 1 >> 64) & masks.big;
+    prev_cont = masks.cont;
+    return {masks.cont, valid, (too_long | last_byte) & valid};
+  }
+
+  static varint_parse_result parse(const char *begin, const char *end, T *result) {
+    const char *p = begin;
+    while (p < end) {
+      // p is at a varint boundary; find the end of the last varint that is
+      // known to be valid before the next flagged byte
+      const char *q = p;
+      const char *valid_end = p;
+      std::size_t count = 0;
+      uint64_t prev_cont = 0;
+      bool flagged = false;
+      for (; q < end && q - p < segment_size && !flagged; q += 64) {
+        const block_scan scan = scan_block(q, end, prev_cont);
+        uint64_t terminators = ~scan.cont & scan.valid;
+        if (scan.suspicious != 0) {
+          terminators &= (1ULL << std::countr_zero(scan.suspicious)) - 1;
+          flagged = true;
+        }
+        count += std::popcount(terminators);
+        if (terminators != 0)
+          valid_end = q + 64 - std::countl_zero(terminators);
+      }
+
+      if (valid_end != p) {
+        Parse(p, valid_end, result);
+        result += count;
+        p = valid_end;
+      }
+      if (flagged || (q >= end && p < end)) {
+        T value;
+        auto r = parse_checked_varint(p, end, value);
+        if (r.ec != std::errc{})
+          return r;
+        *result++ = value;
+        p = r.ptr;
+      }
+    }
+    return {p, {}};
+  }
+};
+
+// Whether the varints of [begin, end), which starts at a varint boundary, are
+// all at most 10 bytes long with a last byte of 0 or 1 when 10 bytes long:
+// the vectorized pass of checked_varint_parser<uint64_t> on its own. Input
+// that passes can be given to any of the unchecked kernels, which may crash or
+// decode garbage on over-long varints. count is set to the number of varints
+// when they fit.
+inline bool varints_fit_64_bits(const char *begin, const char *end, std::size_t &count) {
+  uint64_t prev_cont = 0;
+  std::size_t n = 0;
+  for (const char *q = begin; q < end; q += 64) {
+    const auto scan = checked_varint_parser<uint64_t>::scan_block(q, end, prev_cont);
+    if (scan.suspicious != 0)
+      return false;
+    n += std::popcount(~scan.cont & scan.valid);
+  }
+  count = n;
+  return true;
+}
+
+inline bool varints_fit_64_bits(const char *begin, const char *end) {
+  std::size_t count;
+  return varints_fit_64_bits(begin, end, count);
+}
@@ -0,0 +1,193 @@
+#include "parse_varint.h"
+#include "varint_encoder.h"
+#include "bench_data.h"
+#include "stream_vbyte.h"
+#include "perf_counters.h"
+
+#include <benchmark/benchmark.h>
+#include <map>
+#include <vector>
+
+template <typename Type> char *pack_varint(Type orig_value, char *data) {
+  auto value = std::make_unsigned_t<Type>(orig_value);
+
+  while (value >= 0x80) {
+    *data++ = char((value & 0x7f) | 0x80);
+    value >>= (CHAR_BIT - 1);
+  }
+  *data++ = char(value);
+  return data;
+}
+
+template <auto Fun, auto GetValues = get_values> void BM_fun(benchmark::State &state) {
+  auto count = static_cast<size_t>(state.range(0));
+  auto &values = GetValues(count, bench_distribution(state));
+  std::vector<char> result;
+  result.resize(count * varint_max_size<uint64_t>);
+
+  std::size_t encoded_bytes = 0;
+  perf_counters counters;
+  counters.start();
+  for (auto _ : state) {
+    auto r = Fun(values, result.data());
+    encoded_bytes = r - result.data();
+    benchmark::DoNotOptimize(r);
+  }
+  counters.stop(state, state.iterations() * count);
+  state.SetBytesProcessed(state.iterations() * encoded_bytes);
+  state.SetItemsProcessed(state.iterations() * count);
+}
+
+// get_values() truncated to 32 bits, for the 32-bit formats
+inline const std::vector<uint32_t> &get_values32(std::size_t len, value_distribution dist) {
+  static std::map<std::pair<std::size_t, value_distribution>, std::vector<uint32_t>> all_values;
+  auto &values = all_values[{len, dist}];
+  if (values.size() == 0) {
+    auto &wide = get_values(len, dist);
+    values.assign(wide.begin(), wide.end());
+  }
+  return values;
+}
+
+// Encoded size planning: Fun(values, sizes) returns the total encoded size
+// and may fill sizes with the size of each value.
+template <auto Fun, auto GetValues = get_values> void BM_size(benchmark::State &state) {
+  auto count = static_cast<size_t>(state.range(0));
+  auto &values = GetValues(count, bench_distribution(state));
+  using value_type = typename std::remove_cvref_t<decltype(values)>::value_type;
+  std::vector<uint8_t> sizes(count);
+
+  perf_counters counters;
+  counters.start();
+  for (auto _ : state) {
+    auto r = Fun(std::span<const value_type>{values}, sizes.data());
+    benchmark::DoNotOptimize(r);
+    benchmark::DoNotOptimize(sizes.data());
+  }
+  counters.stop(state, state.iterations() * count);
+  state.SetBytesProcessed(state.iterations() * count * sizeof(value_type));
+  state.SetItemsProcessed(state.iterations() * count);
+}
+
+auto bulk_pack_varint(std::span<const uint64_t> in, char *out) {
+  for (auto v : in)
+    out = pack_varint(v, out);
+  return out;
+}
+
+auto bulk_pdep_encode(std::span<const uint64_t> in, char *out) {
+  return pdep_varint_encoder::encode(in, out);
+}
+
+#ifdef __AVX2__
+auto bulk_avx2_encode(std::span<const uint64_t> in, char *out) {
+  return avx2_varint_encoder::encode(in, out);
+}
+#endif
+
+#if defined(__AVX512BW__) && defined(__AVX512VBMI2__)
+auto bulk_avx512_encode(std::span<const uint64_t> in, char *out) {
+  return avx512_varint_encoder::encode(in, out);
+}
+#endif
+
+auto bulk_pdep_zigzag_encode(std::span<const uint64_t> in, char *out) {
+  return pdep_varint_encoder::encode<zigzag_varint_input>(in, out);
+}
+
+#ifdef __AVX2__
+auto bulk_avx2_zigzag_encode(std::span<const uint64_t> in, char *out) {
+  return avx2_varint_encoder::encode<zigzag_varint_input>(in, out);
+}
+#endif
+
+#if defined(__AVX512BW__) && defined(__AVX512VBMI2__)
+auto bulk_avx512_zigzag_encode(std::span<const uint64_t> in, char *out) {
+  return avx512_varint_encoder::encode<zigzag_varint_input>(in, out);
+}
+#endif
+
+auto bulk_pdep_delta_encode(std::span<const uint64_t> in, char *out) {
+  return pdep_varint_encoder::encode(in, out, delta_varint_input<>{});
+}
+
+#ifdef __AVX2__
+auto bulk_avx2_delta_encode(std::span<const uint64_t> in, char *out) {
+  return avx2_varint_encoder::encode(in, out, delta_varint_input<>{});
+}
+#endif
+
+#if defined(__AVX512BW__) && defined(__AVX512VBMI2__)
+auto bulk_avx512_delta_encode(std::span<const uint64_t> in, char *out) {
+  return avx512_varint_encoder::encode(in, out, delta_varint_input<>{});
+}
+#endif
+
+auto bulk_varint_encode32(std::span<const uint32_t> in, char *out) {
+  return varint_encoder::encode(in, out);
+}
+
+auto bulk_stream_vbyte_encode(std::span<const uint32_t> in, char *out) {
+  return stream_vbyte_encoder::encode(in, out);
+}
+
+template <typename Sizer, typename Input = raw_varint_input>
+struct size_of {
+  template <typename T>
+  static std::size_t total(std::span<const T> in, uint8_t *) {
+    return Sizer::encoded_size(in, Input{});
+  }
+
+  template <typename T>
+  static std::size_t each(std::span<const T> in, uint8_t *sizes) {
+    Sizer::encoded_sizes(in, sizes, Input{});
+    return 0;
+  }
+};
+
+BENCHMARK(BM_fun<bulk_pack_varint>)->Apply(distribution_args<>);
+BENCHMARK(BM_fun<bulk_pdep_encode>)->Apply(distribution_args<>);
+#ifdef __AVX2__
+BENCHMARK(BM_fun<bulk_avx2_encode>)->Apply(distribution_args<>);
+#endif
+#if defined(__AVX512BW__) && defined(__AVX512VBMI2__)
+BENCHMARK(BM_fun<bulk_avx512_encode>)->Apply(distribution_args<>);
+#endif
+
+BENCHMARK(BM_fun<bulk_pdep_zigzag_encode>)->Apply(distribution_args<>);
+#ifdef __AVX2__
+BENCHMARK(BM_fun<bulk_avx2_zigzag_encode>)->Apply(distribution_args<>);
+#endif
+#if defined(__AVX512BW__) && defined(__AVX512VBMI2__)
+BENCHMARK(BM_fun<bulk_avx512_zigzag_encode>)->Apply(distribution_args<>);
+#endif
+
+BENCHMARK(BM_fun<bulk_pdep_delta_encode, get_sorted_values>)->Apply(distribution_args<>);
+#ifdef __AVX2__
+BENCHMARK(BM_fun<bulk_avx2_delta_encode, get_sorted_values>)->Apply(distribution_args<>);
+#endif
+#if defined(__AVX512BW__) && defined(__AVX512VBMI2__)
+BENCHMARK(BM_fun<bulk_avx512_delta_encode, get_sorted_values>)->Apply(distribution_args<>);
+#endif
+
+BENCHMARK(BM_fun<bulk_varint_encode32, get_values32>)->Apply(uint32_distribution_args);
+BENCHMARK(BM_fun<bulk_stream_vbyte_encode, get_values32>)->Apply(uint32_distribution_args);
+
+BENCHMARK(BM_size<size_of<scalar_varint_sizer>::total<uint64_t>>)->Apply(distribution_args<>);
+BENCHMARK(BM_size<size_of<scalar_varint_sizer>::each<uint64_t>>)->Apply(distribution_args<>);
+BENCHMARK(BM_size<size_of<scalar_varint_sizer, zigzag_varint_input>::total<uint64_t>>)->Apply(distribution_args<>);
+BENCHMARK(BM_size<size_of<scalar_varint_sizer>::total<uint32_t>, get_values32>)->Apply(uint32_distribution_args);
+#ifdef __AVX2__
+BENCHMARK(BM_size<size_of<avx2_varint_sizer>::total<uint64_t>>)->Apply(distribution_args<>);
+BENCHMARK(BM_size<size_of<avx2_varint_sizer>::each<uint64_t>>)->Apply(distribution_args<>);
+BENCHMARK(BM_size<size_of<avx2_varint_sizer, zigzag_varint_input>::total<uint64_t>>)->Apply(distribution_args<>);
+BENCHMARK(BM_size<size_of<avx2_varint_sizer>::total<uint32_t>, get_values32>)->Apply(uint32_distribution_args);
+#endif
+#if defined(__AVX512F__) && defined(__AVX512CD__)
+BENCHMARK(BM_size<size_of<avx512_varint_sizer>::total<uint64_t>>)->Apply(distribution_args<>);
+BENCHMARK(BM_size<size_of<avx512_varint_sizer>::each<uint64_t>>)->Apply(distribution_args<>);
+BENCHMARK(BM_size<size_of<avx512_varint_sizer, zigzag_varint_input>::total<uint64_t>>)->Apply(distribution_args<>);
+BENCHMARK(BM_size<size_of<avx512_varint_sizer>::total<uint32_t>, get_values32>)->Apply(uint32_distribution_args);
+#endif
+
+BENCHMARK_MAIN();
@@ -0,0 +1,163 @@
+#pragma once
+#include "checked_varint_parser.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <system_error>
+#ifdef __BMI2__
+#include <immintrin.h>
+#endif
+
+// Decoding of several independent varint streams, such as the columns of a
+// row group, in lockstep. A single stream is latency bound: where a varint
+// starts depends on the length of the one before, so the load, the length
+// computation and the pointer increment form a chain through the whole
+// stream. Advancing Lanes streams by one varint per step gives the
+// out-of-order core Lanes such chains to overlap.
+//
+// A step decodes the varint under each stream's pointer from one 8-byte load;
+// only varints longer than 8 bytes take a branch. Steps run in bursts sized
+// so no stream can reach its end within the burst, and all streams write
+// their values at the same index, so a step costs one pointer update per
+// stream. Once a stream's last 10 bytes are reached, or it has a malformed
+// varint, it is finished with parse_checked_varint() and the others go on in
+// lockstep without it.
+
+// One stream: begin is left where decoding stopped and result after the last
+// value written, with ec as for varint_parse_result.
+struct varint_stream {
+  const char *begin;
+  const char *end;
+  uint64_t *result;
+  std::errc ec{};
+};
+
+template <std::size_t Lanes = 8>
+struct interleaved_varint_parser {
+  static_assert(Lanes > 0);
+
+  // the low 7 bits of the bytes of x, concatenated
+  static inline uint64_t compact_bytes(uint64_t x, uint64_t mask) {
+#ifdef __BMI2__
+    return _pext_u64(x, mask);
+#else
+    x &= mask;
+    x = (x & 0x007f007f007f007fULL) | ((x & 0x7f007f007f007f00ULL) >> 1);
+    x = (x & 0x00003fff00003fffULL) | ((x & 0x3fff00003fff0000ULL) >> 2);
+    return (x & 0x000000000fffffffULL) | ((x & 0x0fffffff00000000ULL) >> 4);
+#endif
+  }
+
+  // Decodes the varint at p, which has at least 10 readable bytes, into
+  // result and advances p. Returns false without advancing when it is longer
+  // than 10 bytes or overflows 64 bits.
+  static inline bool step(const char *&p, uint64_t &result) {
+    uint64_t word;
+    memcpy(&word, p, sizeof(word));
+    const uint64_t terminators = ~word & 0x8080808080808080ULL;
+    if (terminators != 0) [[likely]] {
+      // the bytes up to and including the first terminator
+      const uint64_t bytes = terminators ^ (terminators - 1);
+      result = compact_bytes(word, bytes & 0x7f7f7f7f7f7f7f7fULL);
+      p += (std::countr_zero(terminators) + 1) / 8;
+      return true;
+    }
+    const uint64_t byte8 = uint8_t(p[8]);
+    uint64_t value = compact_bytes(word, 0x7f7f7f7f7f7f7f7fULL) | (byte8 & 0x7f) << 56;
+    if (byte8 < 0x80) {
+      result = value;
+      p += 9;
+      return true;
+    }
+    const uint64_t byte9 = uint8_t(p[9]);
+    if (byte9 > 1)
+      return false;
+    result = value | byte9 << 63;
+    p += 10;
+    return true;
+  }
+
+  // decodes the rest of s one varint at a time, with the checks
+  static inline void finish(varint_stream &s) {
+    while (s.begin < s.end) {
+      const auto [ptr, ec] = parse_checked_varint(s.begin, s.end, *s.result);
+      if (ec != std::errc{}) {
+        s.ec = ec;
+        return;
+      }
+      s.begin = ptr;
+      ++s.result;
+    }
+  }
+
+  // Runs the first n <= N streams of lanes in lockstep until every one is
+  // finished. Each round retires at least one stream, and the others continue
+  // with the code for one lane less, keeping their state in registers.
+  template <std::size_t N>
+  static void parse_lanes(varint_stream **lanes, std::size_t n) {
+    if constexpr (N == 0) {
+      return;
+    } else {
+      if (n < N)
+        return parse_lanes<N - 1>(lanes, n);
+
+      const char *p[N];
+      uint64_t *result[N];
+      for (std::size_t i = 0; i < N; ++i) {
+        p[i] = lanes[i]->begin;
+        result[i] = lanes[i]->result;
+      }
+      // values written to each result in lockstep
+      std::size_t written = 0;
+      unsigned failed = 0;
+      for (;;) {
+        std::ptrdiff_t steps = lanes[0]->end - p[0];
+        for (std::size_t i = 1; i < N; ++i)
+          steps = std::min(steps, lanes[i]->end - p[i]);
+        // no stream moves more than 10 bytes a step
+        steps /= 10;
+        if (steps == 0)
+          break;
+        for (; steps > 0; --steps, ++written) {
+          for (std::size_t i = 0; i < N; ++i)
+            if (!step(p[i], result[i][written])) [[unlikely]]
+              failed |= 1U << i;
+          if (failed != 0) [[unlikely]]
+            break;
+        }
+        if (failed != 0) [[unlikely]]
+          break;
+      }
+
+      // retire the streams close to their end or at a malformed varint
+      std::size_t live = 0;
+      for (std::size_t i = 0; i < N; ++i) {
+        varint_stream &s = *lanes[i];
+        s.begin = p[i];
+        // the lanes that failed stopped one value short of the others
+        s.result = result[i] + written + (failed != 0 && (failed & (1U << i)) == 0);
+        if (s.end - s.begin < 10 || (failed & (1U << i)) != 0)
+          finish(s);
+        else
+          lanes[live++] = &s;
+      }
+      parse_lanes<N - 1>(lanes, live);
+    }
+  }
+
+  // Decodes every stream to its end or first malformed varint, Lanes streams
+  // at a time.
+  static void parse(std::span<varint_stream> streams) {
+    for (std::size_t first = 0; first < streams.size(); first += Lanes) {
+      varint_stream *lanes[Lanes];
+      const std::size_t n = std::min(Lanes, streams.size() - first);
+      for (std::size_t i = 0; i < n; ++i)
+        lanes[i] = &streams[first + i];
+      parse_lanes<Lanes>(lanes, n);
+    }
+  }
+};
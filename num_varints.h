@@ -0,0 +1,212 @@
+#pragma once
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <immintrin.h>
+#include <iterator>
+#include <numeric>
+#include <span>
+#include <utility>
+#if __has_include(<experimental/simd>)
+#include <experimental/simd>
+#endif
+
+// Number of varints in a range: the number of bytes without the continuation
+// bit. A varint cut off by the end of the range isn't counted. This is the
+// sizing step before decoding into a freshly allocated buffer, so the vector
+// kernels process 128 or 256 bytes per iteration to keep up with memory.
+
+// the terminators in the last 1 to 7 bytes of [begin, end)
+inline std::size_t num_varints_partial_word(const char *begin, const char *end) {
+  if (begin == end)
+    return 0;
+  uint64_t v = UINT64_MAX;
+  memcpy(&v, begin, end - begin);
+  return std::popcount(~v & 0x8080808080808080ULL);
+}
+
+inline std::size_t num_varints_unroll1(std::span<const char> range) {
+  std::size_t result = 0;
+  uint64_t v;
+  auto begin = range.data();
+  auto end = range.data() + range.size();
+  for (; (end - begin) >= 8; begin += sizeof(v)) {
+    memcpy(&v, begin, sizeof(v));
+    result += std::popcount(~v & 0x8080808080808080ULL);
+  }
+  return result + num_varints_partial_word(begin, end);
+}
+
+struct dword_iterator {
+  using iterator_category = std::input_iterator_tag;
+  using value_type = std::size_t;
+  using difference_type = std::ptrdiff_t;
+  using reference = value_type;
+  using pointer = void;
+
+  const char *base;
+  dword_iterator() : base(nullptr) {}
+  explicit dword_iterator(const char *b) : base(b) {}
+  dword_iterator(const dword_iterator &) = default;
+  bool operator==(const dword_iterator &) const = default;
+
+  dword_iterator operator++(int) {
+    auto result = *this;
+    base += sizeof(uint64_t);
+    return result;
+  }
+
+  dword_iterator &operator++() {
+    base += sizeof(uint64_t);
+    return *this;
+  }
+
+  value_type operator*() const {
+    uint64_t v;
+    memcpy(&v, base, sizeof(v));
+    return std::popcount(~v & 0x8080808080808080ULL);
+  }
+};
+
+inline std::size_t count_num_varints_by_dword(std::span<const char> range) {
+  dword_iterator first{range.data()};
+  dword_iterator last{range.data() + range.size() - (range.size() % sizeof(uint64_t))};
+  return std::reduce(first, last, std::size_t{0}) +
+         num_varints_partial_word(last.base, range.data() + range.size());
+}
+
+#if __has_include(<experimental/simd>)
+inline std::size_t num_varints_simd(std::span<const char> range) {
+  namespace stdx = std::experimental::parallelism_v2;
+  stdx::simd<int8_t> v, zeros{0};
+  auto range1 = range.subspan(0, (range.size() / v.size()) * v.size());
+  auto range2 = range.subspan(range1.size());
+  std::size_t result = 0;
+  for (; range1.size() > 0; range1 = range1.subspan(v.size())) {
+    v.copy_from(reinterpret_cast<const int8_t *>(range1.data()), stdx::element_aligned);
+    result += stdx::popcount(v >= zeros);
+  }
+  return result + num_varints_unroll1(range2);
+}
+#endif
+
+#ifdef __AVX2__
+// vpmovmskb gathers the continuation bits of 32 bytes; 4 vectors per
+// iteration.
+inline std::size_t num_varints_avx2(std::span<const char> range) {
+  auto begin = range.data();
+  auto end = range.data() + range.size();
+  const auto mask = [](const char *p) {
+    return static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(p))));
+  };
+  std::size_t result = 0;
+  for (; end - begin >= 128; begin += 128) {
+    const uint64_t lo = mask(begin) | (uint64_t(mask(begin + 32)) << 32);
+    const uint64_t hi = mask(begin + 64) | (uint64_t(mask(begin + 96)) << 32);
+    result += std::popcount(~lo) + std::popcount(~hi);
+  }
+  for (; end - begin >= 32; begin += 32)
+    result += std::popcount(~mask(begin));
+  return result + num_varints_unroll1({begin, end});
+}
+#endif
+
+#ifdef __AVX512BW__
+// vpcmpb sets a mask bit for every byte that is >= 0 as a signed value, i.e.
+// every terminator; 4 vectors per iteration.
+inline std::size_t num_varints_avx512(std::span<const char> range) {
+  auto begin = range.data();
+  auto end = range.data() + range.size();
+  const __m512i minus_one = _mm512_set1_epi8(-1);
+  const auto mask = [&](const char *p) {
+    return static_cast<uint64_t>(_mm512_cmpgt_epi8_mask(_mm512_loadu_si512(p), minus_one));
+  };
+  std::size_t result = 0;
+  for (; end - begin >= 256; begin += 256)
+    result += std::popcount(mask(begin)) + std::popcount(mask(begin + 64)) +
+              std::popcount(mask(begin + 128)) + std::popcount(mask(begin + 192));
+  for (; end - begin >= 64; begin += 64)
+    result += std::popcount(mask(begin));
+  if (begin == end)
+    return result;
+  const __mmask64 tail = _cvtu64_mask64((1ULL << (end - begin)) - 1);
+  return result + std::popcount(static_cast<uint64_t>(
+                      _mm512_mask_cmpgt_epi8_mask(tail, _mm512_maskz_loadu_epi8(tail, begin), minus_one)));
+}
+#endif
+
+// the fastest kernel the target has
+inline std::size_t num_varints(std::span<const char> range) {
+#if defined(__AVX512BW__)
+  return num_varints_avx512(range);
+#elif defined(__AVX2__)
+  return num_varints_avx2(range);
+#else
+  return num_varints_unroll1(range);
+#endif
+}
+
+// Bit i is set when byte i of the 64 at p ends a varint.
+inline uint64_t varint_terminator_mask(const char *p) {
+#if defined(__AVX512BW__)
+  return _mm512_cmpgt_epi8_mask(_mm512_loadu_si512(p), _mm512_set1_epi8(-1));
+#elif defined(__AVX2__)
+  const auto mask = [](const char *q) {
+    return static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(q))));
+  };
+  return ~(mask(p) | (uint64_t(mask(p + 32)) << 32));
+#else
+  uint64_t result = 0;
+  for (int i = 0; i < 64; i += 8) {
+    uint64_t v;
+    memcpy(&v, p + i, sizeof(v));
+    // gathers the top bits of the 8 bytes into the top byte
+    result |= ((((~v & 0x8080808080808080ULL) >> 7) * 0x0102040810204080ULL) >> 56) << i;
+  }
+  return result;
+#endif
+}
+
+// index of the set bit of mask with n set bits below it
+inline int nth_set_bit(uint64_t mask, std::size_t n) {
+#ifdef __BMI2__
+  return std::countr_zero(_pdep_u64(1ULL << n, mask));
+#else
+  for (; n > 0; --n)
+    mask &= mask - 1;
+  return std::countr_zero(mask);
+#endif
+}
+
+// Skips n varints of [begin, end) without decoding them, counting terminators
+// 64 bytes at a time. Returns the position after the n-th varint and n, or
+// when there are fewer, the position after the last complete varint and their
+// number.
+inline std::pair<const char *, std::size_t> skip_varints(const char *begin, const char *end, std::size_t n) {
+  std::size_t count = 0;
+  const char *last = begin;
+  const auto block = [&](const char *p, uint64_t terminators) {
+    const auto c = static_cast<std::size_t>(std::popcount(terminators));
+    if (count + c >= n) {
+      last = p + nth_set_bit(terminators, n - count - 1) + 1;
+      count = n;
+      return true;
+    }
+    if (terminators != 0)
+      last = p + (63 - std::countl_zero(terminators)) + 1;
+    count += c;
+    return false;
+  };
+  if (n == 0)
+    return {begin, 0};
+  for (; end - begin >= 64; begin += 64)
+    if (block(begin, varint_terminator_mask(begin)))
+      return {last, count};
+  if (begin < end) {
+    alignas(64) char padded[64];
+    memset(padded, 0x80, sizeof(padded));
+    memcpy(padded, begin, end - begin);
+    block(begin, varint_terminator_mask(padded));
+  }
+  return {last, count};
+}
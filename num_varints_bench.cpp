@@ -1,7 +1,11 @@
+#include "num_varints.h"
+#include "perf_counters.h"
+#include "varint_dispatch.h"
+
 #include <benchmark/benchmark.h>
 
+#include <algorithm>
 #include <execution>
-#include <experimental/simd>
 #include <numeric>
 #include <random>
 #include <span>
@@ -37,84 +41,6 @@ std::size_t num_varints_unseq(std::span<const char> range) {
 // }
 
 
-struct dword_iterator {
-  using value_type = int;
-
-  const char *base;
-  dword_iterator() : base(nullptr) {}
-  explicit dword_iterator(const char *b) : base(b) {}
-  dword_iterator(const dword_iterator &) = default;
-  bool operator==(const dword_iterator &) const = default;
-
-  dword_iterator operator++(int) const {
-    return dword_iterator{base + sizeof(uint64_t)};
-  }
-
-  dword_iterator &operator++() {
-    base += sizeof(uint64_t);
-    return *this;
-  }
-
-  int operator*() const {
-    uint64_t v;
-    memcpy(&v, base, sizeof(v));
-    return std::popcount(v);
-  }
-};
-
-inline auto count_num_varints_by_dword(std::span<const char> range) {
-  dword_iterator first{range.data()};
-  dword_iterator last{range.data() + range.size() - (range.size() % sizeof(uint64_t))};
-
-  int result = std::reduce(std::execution::seq, first, last, 0);
-  if (range.size() % sizeof(uint64_t) == 0) return result;
-  uint64_t v = -1;
-  memcpy(&v, last.base, range.data() + range.size() - last.base);
-  return result + std::popcount(~v & 0x8080808080808080ULL);
-}
-
-#if !defined(__clang__) || !defined(__APPLE_)
-
-std::size_t num_varints_simd(std::span<const char> range) {
-  namespace stdx = std::experimental::parallelism_v2;
-  stdx::simd<int8_t> v, zeros{0};
-  auto range1 = range.subspan(0, (range.size()/v.size())*v.size());
-  auto range2 = range.subspan(range1.size());
-  std::size_t result = 0;
-  for (; range1.size() > 0; range1 = range1.subspan(v.size())) {
-    v.copy_from(reinterpret_cast<const int8_t *>(range1.data()), stdx::element_aligned);
-    result += stdx::popcount(v < zeros);
-  }
-
-  if (range2.empty()) return result;
-  std::array<uint8_t, v.size()> remaining{255};
-  auto it = std::copy(range2.begin(), range2.end(), remaining.data());
-  v.copy_from(remaining.begin(), stdx::element_aligned);
-  result += stdx::popcount(v < zeros);
-
-  return result;
-}
-
-#endif
-
-std::size_t num_varints_unroll1(std::span<const char> range) {
-  std::size_t result = 0;
-  uint64_t v;
-  auto begin = range.data();
-  auto end = range.data() + range.size();
-  // for (; range.size() >=8; range = range.subspan( sizeof(v))) {
-  for (; (end - begin) >= 8; begin+= sizeof(v)) {
-    memcpy(&v,begin, sizeof(v));
-    // memcpy(&v,range.data(), sizeof(v));
-    result += std::popcount(~v & 0x8080808080808080ULL);
-  }
-  if (0 == end - begin) return result;
-  v = UINT64_MAX;
-  memcpy(&v,begin, end - begin);
-  result += std::popcount(~v & 0x8080808080808080ULL);
-  return result;
-}
-
 std::size_t num_varints_unroll2(std::span<const char> range) {
   std::size_t result = 0;
   uint64_t v;
@@ -131,6 +57,7 @@ std::size_t num_varints_unroll2(std::span<const char> range) {
   return result;
 }
 
+#ifdef __cpp_lib_ranges_chunk
 std::size_t num_varints_range_alg(std::span<const char> range) {
   auto dwords = range | std::views::chunk(sizeof(uint64_t)) | std::views::transform([](auto&& chunk) { 
     uint64_t v;
@@ -140,100 +67,52 @@ std::size_t num_varints_range_alg(std::span<const char> range) {
   
   return std::accumulate(dwords.begin(), dwords.end(), 0);
 }
+#endif
 
 
+// From a few cache lines to buffers far larger than the last level cache,
+// where counting should run at memory bandwidth.
+void size_args(benchmark::internal::Benchmark *b) {
+  for (int64_t count : {16, 32, 128, 300, 1000, 10000, 1 << 16, 1 << 20, 4 << 20, 16 << 20})
+    b->Args({count});
+}
+
 template <auto Fun> void BM_fun(benchmark::State &state) {
   auto count = static_cast<size_t>(state.range(0));
 
   std::vector<char> array(count);
   std::iota(array.begin(), array.end(), 1);
+  std::shuffle(array.begin(), array.end(), std::mt19937(0x5eed));
+  const auto varints = static_cast<uint64_t>(std::ranges::count_if(array, [](char v) { return int8_t(v) >= 0; }));
 
-  // Create a random number generator
-  std::random_device rd;  // Obtain a random number from hardware
-  std::mt19937 gen(rd()); // Seed the generator
-
-  // Shuffle the elements of the vector
-  std::shuffle(array.begin(), array.end(), gen);
-
+  // the counters are per counted varint
+  varint_bench_counters counters;
+  counters.start();
   for (auto _ : state) {
     auto r = Fun(array);
-    //auto r = Fun(array.data(), array.data()+array.size());
     benchmark::DoNotOptimize(r);
   }
+  counters.stop(state, state.iterations() * varints);
+  state.SetBytesProcessed(state.iterations() * count);
+  state.SetItemsProcessed(state.iterations() * count);
 }
-BENCHMARK(BM_fun<num_varints_simple_forloop>)
-    ->Args({16})
-    ->Args({32})
-    ->Args({128})
-    ->Args({200})
-    ->Args({300})
-    ->Args({1000})
-    ->Args({10000});
-BENCHMARK(BM_fun<num_varints_unseq>)
-    ->Args({16})
-    ->Args({32})
-    ->Args({128})
-    ->Args({200})
-    ->Args({300})
-    ->Args({1000})
-    ->Args({10000});
-// BENCHMARK(BM_fun<num_varints_popcount>)
-//     ->Args({10})
-//     ->Args({30})
-//     ->Args({100})
-//     ->Args({200})
-//     ->Args({300})
-//     ->Args({1000});
-// BENCHMARK(BM_fun<num_varints_popcount_unseq>)
-//     ->Args({10})
-//     ->Args({30})
-//     ->Args({100})
-//     ->Args({200})
-//     ->Args({300})
-//     ->Args({1000});
-#if !defined(__clang__) || !defined(__APPLE_)
-BENCHMARK(BM_fun<num_varints_simd>)
-    ->Args({16})
-    ->Args({32})
-    ->Args({128})
-    ->Args({200})
-    ->Args({300})
-    ->Args({1000})
-    ->Args({10000});
+BENCHMARK(BM_fun<num_varints_simple_forloop>)->Apply(size_args);
+BENCHMARK(BM_fun<num_varints_unseq>)->Apply(size_args);
+#if __has_include(<experimental/simd>)
+BENCHMARK(BM_fun<num_varints_simd>)->Apply(size_args);
+#endif
+BENCHMARK(BM_fun<num_varints_unroll1>)->Apply(size_args);
+BENCHMARK(BM_fun<num_varints_unroll2>)->Apply(size_args);
+BENCHMARK(BM_fun<count_num_varints_by_dword>)->Apply(size_args);
+#ifdef __cpp_lib_ranges_chunk
+BENCHMARK(BM_fun<num_varints_range_alg>)->Apply(size_args);
+#endif
+#ifdef __AVX2__
+BENCHMARK(BM_fun<num_varints_avx2>)->Apply(size_args);
+#endif
+#ifdef __AVX512BW__
+BENCHMARK(BM_fun<num_varints_avx512>)->Apply(size_args);
 #endif
-BENCHMARK(BM_fun<num_varints_unroll1>)
-    ->Args({16})
-    ->Args({32})
-    ->Args({128})
-    ->Args({200})
-    ->Args({300})
-    ->Args({1000})
-    ->Args({10000});
-BENCHMARK(BM_fun<num_varints_unroll2>)
-    ->Args({16})
-    ->Args({32})
-    ->Args({128})
-    ->Args({200})
-    ->Args({300})
-    ->Args({1000})
-    ->Args({10000});
-
-BENCHMARK(BM_fun<count_num_varints_by_dword>)
-    ->Args({16})
-    ->Args({32})
-    ->Args({128})
-    ->Args({200})
-    ->Args({300})
-    ->Args({1000})
-    ->Args({10000});
-
-BENCHMARK(BM_fun<num_varints_range_alg>)
-    ->Args({16})
-    ->Args({32})
-    ->Args({128})
-    ->Args({200})
-    ->Args({300})
-    ->Args({1000})
-    ->Args({10000});
+BENCHMARK(BM_fun<dispatch_count_varints>)->Apply(size_args);
 
 BENCHMARK_MAIN();
@@ -0,0 +1,50 @@
+#include "parallel_varint_parser.h"
+#include "varint_encoder.h"
+#include "bench_data.h"
+
+#include <benchmark/benchmark.h>
+#include <map>
+#include <memory>
+#include <vector>
+
+const std::vector<char> &get_data(std::size_t len) {
+  static std::map<std::size_t, std::vector<char>> all_data;
+  auto &data = all_data[len];
+  if (data.size() == 0) {
+    auto &values = get_values(len, value_distribution::uniform);
+    data.resize(len * varint_max_size<uint64_t>);
+    auto end = varint_encoder::encode(std::span{values}, data.data());
+    data.resize(end - data.data());
+  }
+  return data;
+}
+
+// Scaling of the full count, prefix sum and decode sequence with the number of
+// threads; range(0) is the number of varints, range(1) the number of threads.
+void BM_parallel_parse(benchmark::State &state) {
+  auto count = static_cast<size_t>(state.range(0));
+  auto num_threads = static_cast<unsigned>(state.range(1));
+  auto &data = get_data(count);
+  std::unique_ptr<uint64_t[]> result(new uint64_t[count]);
+
+  for (auto _ : state) {
+    auto partition = partition_varints(data, num_threads);
+    parallel_parse_varints(partition, result.get());
+    benchmark::DoNotOptimize(result.get());
+  }
+  state.SetBytesProcessed(state.iterations() * data.size());
+  state.SetItemsProcessed(state.iterations() * count);
+}
+
+void thread_counts(benchmark::internal::Benchmark *b) {
+  const auto max_threads = std::max(1U, std::thread::hardware_concurrency());
+  for (auto count : {1 << 20, 1 << 25}) {
+    for (unsigned threads = 1; threads < max_threads; threads *= 2)
+      b->Args({count, threads});
+    b->Args({count, max_threads});
+  }
+}
+
+BENCHMARK(BM_parallel_parse)->Apply(thread_counts)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,84 @@
+#pragma once
+#include "varint_dispatch.h"
+
+#include <algorithm>
+#include <numeric>
+#include <span>
+#include <thread>
+#include <vector>
+
+// Multi-threaded decoding of large buffers in three steps:
+//   1. the buffer is split into chunks at varint boundaries;
+//   2. the varints of every chunk are counted in parallel and an exclusive
+//      prefix sum of the counts gives each chunk's offset in the output;
+//   3. the chunks are decoded concurrently into their own output slices.
+// Steps 1 and 2 are partition_varints(), step 3 is parallel_parse_varints().
+// The caller allocates the output in between, so it doesn't need to be
+// initialized by a single thread first. Like the bulk parsers, these expect
+// data to hold complete varints only.
+
+struct varint_partition {
+  std::vector<std::span<const char>> chunks;
+  // index of the first value of each chunk in the decoded output
+  std::vector<std::size_t> offsets;
+  std::size_t count = 0;
+};
+
+template <typename F>
+void run_parallel(std::size_t n, F f) {
+  std::vector<std::jthread> threads;
+  threads.reserve(n);
+  for (std::size_t i = 1; i < n; ++i)
+    threads.emplace_back(f, i);
+  if (n > 0)
+    f(0);
+}
+
+// Splits data into at most num_chunks pieces of roughly equal size, each one
+// ending right after a varint terminator (or at the end of data).
+inline std::vector<std::span<const char>> split_at_varint_boundaries(std::span<const char> data,
+                                                                     std::size_t num_chunks) {
+  std::vector<std::span<const char>> result;
+  auto begin = data.data();
+  auto end = data.data() + data.size();
+  for (std::size_t i = 1; i <= num_chunks && begin < end; ++i) {
+    auto split = std::max(begin + 1, data.data() + data.size() * i / num_chunks);
+    if (split < end) {
+      split = std::find_if(split - 1, end, [](char c) { return int8_t(c) >= 0; });
+      split = split == end ? end : split + 1;
+    }
+    result.emplace_back(begin, split);
+    begin = split;
+  }
+  return result;
+}
+
+template <typename Count>
+varint_partition partition_varints(std::span<const char> data, unsigned num_threads, Count count) {
+  varint_partition result;
+  result.chunks = split_at_varint_boundaries(data, num_threads);
+  result.offsets.resize(result.chunks.size());
+  run_parallel(result.chunks.size(), [&](std::size_t i) { result.offsets[i] = count(result.chunks[i]); });
+  result.count = std::accumulate(result.offsets.begin(), result.offsets.end(), std::size_t{0});
+  std::exclusive_scan(result.offsets.begin(), result.offsets.end(), result.offsets.begin(),
+                      std::size_t{0});
+  return result;
+}
+
+inline varint_partition partition_varints(std::span<const char> data, unsigned num_threads) {
+  return partition_varints(data, num_threads, dispatch_count_varints);
+}
+
+// Decodes every chunk of partition into result, which must have room for
+// partition.count values.
+template <typename T, typename Parse>
+void parallel_parse_varints(const varint_partition &partition, T *result, Parse parse) {
+  run_parallel(partition.chunks.size(), [&](std::size_t i) {
+    auto chunk = partition.chunks[i];
+    parse(chunk.data(), chunk.data() + chunk.size(), result + partition.offsets[i]);
+  });
+}
+
+inline void parallel_parse_varints(const varint_partition &partition, uint64_t *result) {
+  parallel_parse_varints(partition, result, dispatch_parse_varints);
+}
@@ -4,6 +4,7 @@
 #include <system_error>
 #include <span>
 #include <cstdint>
+#include <type_traits>
 
 template <typename Type>
 constexpr auto varint_max_size = sizeof(Type) * CHAR_BIT / (CHAR_BIT - 1) + 1;
@@ -70,6 +71,22 @@ struct parse_varint_unrolled
     }
 };
 
+// Zigzag mapping of protobuf sint32/sint64 fields: 0, -1, 1, -2, ... are
+// encoded as 0, 1, 2, 3, ... so that small negative values get short varints.
+template <typename Type>
+constexpr std::make_unsigned_t<Type> zigzag_encode(Type value)
+{
+    using value_type = std::make_unsigned_t<Type>;
+    using signed_type = std::make_signed_t<Type>;
+    return (value_type(value) << 1) ^ value_type(signed_type(value) >> (sizeof(Type) * CHAR_BIT - 1));
+}
+
+template <typename Type>
+constexpr Type zigzag_decode(std::make_unsigned_t<Type> value)
+{
+    return static_cast<Type>((value >> 1) ^ (0 - (value & 1)));
+}
+
 // Shifts "byte" left by n * 7 bits, filling vacated bits from `ones`.
 // template <int n>
 constexpr inline int64_t VarintShlByte(int n, int8_t byte, int64_t ones)
@@ -1,66 +1,90 @@
 #include "parse_varint.h"
 #include "varint_parser.h"
+#include "varint_encoder.h"
+#include "bench_data.h"
+#include "varint_dispatch.h"
+#include "checked_varint_parser.h"
+#include "varint32_parser.h"
+#include "stream_vbyte.h"
+#include "perf_counters.h"
+#include "adaptive_varint_parser.h"
+#include "varint_index.h"
+#include "varint_sinks.h"
+#include "interleaved_varint_parser.h"
+#include "protobuf_wire.h"
+#include "protobuf_scanner.h"
+#include "varint_records.h"
 
 #include <benchmark/benchmark.h>
 #include <map>
+#include <numeric>
 #include <random>
+#include <tuple>
 #include <vector>
 
-static std::vector<char> data;
-
-template <typename Type> char *pack_varint(Type orig_value, char *data) {
-  auto value = std::make_unsigned_t<Type>(orig_value);
-
-  while (value >= 0x80) {
-    *data++ = char((value & 0x7f) | 0x80);
-    value >>= (CHAR_BIT - 1);
+// The values of a distribution as varints. Delta coded columns decode
+// value_distribution::timestamps and int32 columns the way protobuf writes
+// them value_distribution::negative_int32.
+const std::vector<char> &get_data(std::size_t len, value_distribution dist) {
+  static std::map<std::pair<std::size_t, value_distribution>, std::vector<char>> all_data;
+  auto &data = all_data[{len, dist}];
+  if (data.size() == 0) {
+    auto &values = get_values(len, dist);
+    data.resize(len * varint_max_size<uint64_t>);
+    auto end = varint_encoder::encode(std::span{values}, data.data());
+    data.resize(end - data.data());
   }
-  *data++ = char(value);
   return data;
 }
 
-const std::vector<char> get_data(std::size_t len) {
-  static std::map<std::size_t, std::vector<char>> all_data;
-  auto &data = all_data[len];
+// The values of a distribution in Stream VByte, truncated to 32 bits.
+const std::vector<char> &get_stream_vbyte_data(std::size_t len, value_distribution dist) {
+  static std::map<std::pair<std::size_t, value_distribution>, std::vector<char>> all_data;
+  auto &data = all_data[{len, dist}];
   if (data.size() == 0) {
-    std::random_device rd;
-    std::mt19937 engine(rd());
-    constexpr uint64_t level[] = {
-      0x00ULL,
-      0x80ULL,
-      0x4000ULL,
-      0x200000ULL,
-      0x10000000ULL,
-      0x0800000000ULL,
-      0x040000000000ULL,
-      0x02000000000000ULL,
-      0x0100000000000000ULL,
-    };
-    std::uniform_int_distribution<unsigned long long> dis(
-        level[0],
-        level[4]-1);
-
-    data.resize(len * 10);
-    auto buf = data.data();
-    for (auto i = 0U; i < len; ++i) {
-      buf = pack_varint(dis(engine), buf);
-    }
-    std::size_t s = buf - data.data();
-    data.resize(buf - data.data());
+    auto &values = get_values(len, dist);
+    std::vector<uint32_t> values32(values.begin(), values.end());
+    data.resize(stream_vbyte_max_size(len));
+    auto end = stream_vbyte_encoder::encode(values32, data.data());
+    data.resize(end - data.data());
   }
   return data;
 }
 
 template <auto Fun> void BM_fun(benchmark::State &state) {
   auto count = static_cast<size_t>(state.range(0));
-  auto &data = get_data(count);
+  auto &data = get_data(count, bench_distribution(state));
   std::vector<uint64_t> result;
   result.resize(count);
 
+  varint_bench_counters counters;
+  counters.start();
   for (auto _ : state) {
     auto r = Fun(data.data(), data.data() + data.size(), result.data());
     benchmark::DoNotOptimize(r);
   }
+  counters.stop(state, state.iterations() * count);
+  state.SetBytesProcessed(state.iterations() * data.size());
+  state.SetItemsProcessed(state.iterations() * count);
+}
+
+// Same as BM_fun with the input in a varint_buffer, for the decoders' padded
+// overloads.
+template <auto Fun> void BM_padded(benchmark::State &state) {
+  auto count = static_cast<size_t>(state.range(0));
+  const varint_buffer<> data(get_data(count, bench_distribution(state)));
+  std::vector<uint64_t> result;
+  result.resize(count);
+
+  varint_bench_counters counters;
+  counters.start();
+  for (auto _ : state) {
+    auto r = Fun(data, result.data());
+    benchmark::DoNotOptimize(r);
+  }
+  counters.stop(state, state.iterations() * count);
+  state.SetBytesProcessed(state.iterations() * data.size());
+  state.SetItemsProcessed(state.iterations() * count);
 }
 
 auto bulk_bmi_parse(const char *begin, const char *end, uint64_t *res) {
@@ -68,6 +92,33 @@ auto bulk_bmi_parse(const char *begin, const char *end, uint64_t *res) {
   return parser.parse(begin, end, res);
 }
 
+// Throughput of bmi_varint_parser for each MaskLength. The code size of its
+// 1 << MaskLength word handlers isn't known at run time; it is the sum of the
+// parse_word_as symbol sizes reported by `nm -S -C parse_varint_bench`.
+template <int MaskLength> void BM_bmi_mask_length(benchmark::State &state) {
+  using parser_type = bmi_varint_parser<MaskLength, uint64_t>;
+  auto count = static_cast<size_t>(state.range(0));
+  auto &data = get_data(count, bench_distribution(state));
+  std::vector<uint64_t> result;
+  result.resize(count);
+
+  varint_bench_counters counters;
+  counters.start();
+  for (auto _ : state) {
+    parser_type parser;
+    auto r = parser.parse(data.data(), data.data() + data.size(), result.data());
+    benchmark::DoNotOptimize(r);
+  }
+  counters.stop(state, state.iterations() * count);
+  state.SetBytesProcessed(state.iterations() * data.size());
+  state.SetItemsProcessed(state.iterations() * count);
+}
+
+auto padded_bmi_parse(const varint_buffer<> &data, uint64_t *res) {
+  bmi_varint_parser<6, uint64_t> parser;
+  return parser.parse(data, res);
+}
+
 auto bulk_shift_mix_parse(const char *begin, const char *end, uint64_t *res) {
   while (begin < end) {
     
@@ -102,7 +153,7 @@ constexpr inline const Byte *unrolled_parse_varint(const Byte *p, const Byte *en
 
 auto bulk_unroll_parse(const char *begin, const char *end, uint64_t *res) {
   while (begin < end) {
-    begin = unrolled_parse_varint(begin, end+1, *res++);
+    begin = unrolled_parse_varint(begin, end, *res++);
   }
   return begin;
 }
@@ -111,12 +162,589 @@ auto bulk_ubfx_parse(const char *begin, const char *end, uint64_t *res) {
   return ubfx_varint_parser::parse(begin, end, res);
 }
 
+auto padded_ubfx_parse(const varint_buffer<> &data, uint64_t *res) {
+  return ubfx_varint_parser::parse(data, res);
+}
+
+#ifdef __AVX2__
+auto bulk_masked_vbyte_parse(const char *begin, const char *end, uint64_t *res) {
+  return masked_vbyte_parser<32>::parse(begin, end, res);
+}
+#endif
+
+#ifdef __AVX512BW__
+auto bulk_masked_vbyte512_parse(const char *begin, const char *end, uint64_t *res) {
+  return masked_vbyte_parser<64>::parse(begin, end, res);
+}
+#endif
+
+auto bulk_checked_ubfx_parse(const char *begin, const char *end, uint64_t *res) {
+  return checked_varint_parser<uint64_t>::parse(begin, end, res).ptr;
+}
+
+#ifdef __AVX2__
+auto bulk_checked_masked_vbyte_parse(const char *begin, const char *end, uint64_t *res) {
+  return checked_varint_parser<uint64_t, &masked_vbyte_parser<32>::parse<uint64_t>>::parse(begin, end, res).ptr;
+}
+#endif
+
+// 32-bit output; the result buffer of BM_fun has room for twice as many
+auto bulk_ubfx_parse32(const char *begin, const char *end, uint64_t *res) {
+  return ubfx_varint_parser::parse(begin, end, reinterpret_cast<uint32_t *>(res));
+}
+
+#ifdef __AVX2__
+auto bulk_masked_vbyte_parse32(const char *begin, const char *end, uint64_t *res) {
+  return masked_vbyte_parser<32>::parse(begin, end, reinterpret_cast<uint32_t *>(res));
+}
+#endif
+
+auto bulk_checked_ubfx_parse32(const char *begin, const char *end, uint64_t *res) {
+  return checked_varint_parser<uint32_t>::parse(begin, end, reinterpret_cast<uint32_t *>(res)).ptr;
+}
+
+auto bulk_varint32_parse(const char *begin, const char *end, uint64_t *res) {
+  return varint32_parser<uint32_t>::parse(begin, end, reinterpret_cast<uint32_t *>(res)).ptr;
+}
+
+auto bulk_ubfx_parse_int32(const char *begin, const char *end, uint64_t *res) {
+  return ubfx_varint_parser::parse(begin, end, reinterpret_cast<int32_t *>(res));
+}
+
+auto bulk_checked_ubfx_parse_int32(const char *begin, const char *end, uint64_t *res) {
+  return checked_varint_parser<int32_t>::parse(begin, end, reinterpret_cast<int32_t *>(res)).ptr;
+}
+
+auto bulk_varint32_parse_int32(const char *begin, const char *end, uint64_t *res) {
+  return varint32_parser<int32_t>::parse(begin, end, reinterpret_cast<int32_t *>(res)).ptr;
+}
+
+// sint64 columns: the decode-then-convert baseline and the fused decoders
+auto bulk_bmi_parse_unzigzag(const char *begin, const char *end, uint64_t *res) {
+  bmi_varint_parser<6, uint64_t> parser;
+  auto r = parser.parse(begin, end, res);
+  for (auto p = res; p != parser.res; ++p)
+    *p = zigzag_decode<int64_t>(*p);
+  return r;
+}
+
+auto bulk_zigzag_bmi_parse(const char *begin, const char *end, uint64_t *res) {
+  bmi_varint_parser<6, uint64_t, zigzag_varint_output> parser;
+  return parser.parse(begin, end, res);
+}
+
+auto bulk_zigzag_ubfx_parse(const char *begin, const char *end, uint64_t *res) {
+  return basic_ubfx_varint_parser<zigzag_varint_output>::parse(begin, end, res);
+}
+
+#ifdef __AVX2__
+auto bulk_zigzag_masked_vbyte_parse(const char *begin, const char *end, uint64_t *res) {
+  return masked_vbyte_parser<32, zigzag_varint_output>::parse(begin, end, res);
+}
+#endif
+
+// delta encoded sorted columns: the decode-then-prefix-sum baseline and the
+// fused decoders
+auto bulk_bmi_parse_prefix_sum(const char *begin, const char *end, uint64_t *res) {
+  bmi_varint_parser<6, uint64_t> parser;
+  auto r = parser.parse(begin, end, res);
+  std::inclusive_scan(res, parser.res, res);
+  return r;
+}
+
+auto bulk_delta_bmi_parse(const char *begin, const char *end, uint64_t *res) {
+  bmi_varint_parser<6, uint64_t, delta_varint_output<>> parser;
+  return parser.parse(begin, end, res);
+}
+
+auto bulk_delta_ubfx_parse(const char *begin, const char *end, uint64_t *res) {
+  return basic_ubfx_varint_parser<delta_varint_output<>>::parse(begin, end, res);
+}
+
+#ifdef __AVX2__
+auto bulk_delta_masked_vbyte_parse(const char *begin, const char *end, uint64_t *res) {
+  return masked_vbyte_parser<32, delta_varint_output<>>::parse(begin, end, res);
+}
+#endif
+
+// Stream VByte against the 32-bit LEB128 decoders above, for the same values
+void BM_stream_vbyte_decode(benchmark::State &state) {
+  auto count = static_cast<size_t>(state.range(0));
+  auto &data = get_stream_vbyte_data(count, bench_distribution(state));
+  std::vector<uint32_t> result;
+  result.resize(count);
+
+  varint_bench_counters counters;
+  counters.start();
+  for (auto _ : state) {
+    auto r = stream_vbyte_decoder::decode(data.data(), data.data() + data.size(), count, result.data());
+    benchmark::DoNotOptimize(r);
+  }
+  counters.stop(state, state.iterations() * count);
+  state.SetBytesProcessed(state.iterations() * data.size());
+  state.SetItemsProcessed(state.iterations() * count);
+}
+
+// LEB128 to Stream VByte; BM_fun's result buffer has room for the output
+auto bulk_stream_vbyte_transcode(const char *begin, const char *end, uint64_t *res) {
+  return stream_vbyte_transcoder::from_varints(begin, end, reinterpret_cast<char *>(res)).first;
+}
+
+// a long lived front end; the cost model is calibrated on its first call
+auto bulk_adaptive_parse(const char *begin, const char *end, uint64_t *res) {
+  static adaptive_varint_parser<> parser;
+  return parser.parse(begin, end, res);
+}
+
+auto bulk_dispatch_parse(const char *begin, const char *end, uint64_t *res) {
+  return dispatch_parse_varints(begin, end, res);
+}
+
+// Point lookups of random varints, through a varint_index with checkpoints
+// every Stride varints, or with Stride == 0 by skipping from the start.
+template <std::size_t Stride> void BM_index_lookup(benchmark::State &state) {
+  auto count = static_cast<size_t>(state.range(0));
+  auto &data = get_data(count, bench_distribution(state));
+  const varint_index<> index(data, Stride == 0 ? count : Stride);
+  std::vector<std::size_t> ordinals(1024);
+  std::mt19937_64 engine(0x5eed);
+  for (auto &i : ordinals)
+    i = engine() % count;
+
+  for (auto _ : state) {
+    std::errc ec{};
+    for (auto i : ordinals) {
+      uint64_t v = 0;
+      if constexpr (Stride == 0)
+        ec = parse_checked_varint(skip_varints(data.data(), data.data() + data.size(), i).first,
+                                  data.data() + data.size(), v)
+                 .ec;
+      else
+        ec = index.at(i, v);
+      if (ec != std::errc{}) [[unlikely]]
+        break;
+      benchmark::DoNotOptimize(v);
+    }
+    if (ec != std::errc{}) [[unlikely]] {
+      state.SkipWithError("lookup failed");
+      break;
+    }
+  }
+  // lookups are items; the bytes skipped over depend on the stride
+  state.SetItemsProcessed(state.iterations() * ordinals.size());
+}
+
+// building the index: one pass over the terminators of the buffer
+void BM_index_build(benchmark::State &state) {
+  auto count = static_cast<size_t>(state.range(0));
+  auto &data = get_data(count, bench_distribution(state));
+  for (auto _ : state) {
+    const varint_index<> index(data, 128);
+    benchmark::DoNotOptimize(index.num_checkpoints());
+  }
+  state.SetBytesProcessed(state.iterations() * data.size());
+  state.SetItemsProcessed(state.iterations() * count);
+}
+
+// Sum of a column decoded into an array and read back, against the sinks
+// consuming the values as they are decoded.
+template <auto Parse> void BM_sum_array(benchmark::State &state) {
+  auto count = static_cast<size_t>(state.range(0));
+  auto &data = get_data(count, bench_distribution(state));
+  std::vector<uint64_t> result(count);
+
+  varint_bench_counters counters;
+  counters.start();
+  for (auto _ : state) {
+    Parse(data.data(), data.data() + data.size(), result.data());
+    benchmark::DoNotOptimize(std::accumulate(result.begin(), result.end(), uint64_t{0}));
+  }
+  counters.stop(state, state.iterations() * count);
+  state.SetBytesProcessed(state.iterations() * data.size());
+  state.SetItemsProcessed(state.iterations() * count);
+}
+
+template <auto Parse, typename Sink> void BM_sink(benchmark::State &state) {
+  auto count = static_cast<size_t>(state.range(0));
+  auto &data = get_data(count, bench_distribution(state));
+  std::vector<uint32_t> selection(count);
+
+  varint_bench_counters counters;
+  counters.start();
+  for (auto _ : state) {
+    Sink sink = [&] {
+      if constexpr (std::is_same_v<Sink, greater_varint_sink<>>)
+        return Sink(1 << 14, selection.data());
+      else
+        return Sink{};
+    }();
+    Parse(data.data(), data.data() + data.size(), &sink);
+    benchmark::DoNotOptimize(sink);
+  }
+  counters.stop(state, state.iterations() * count);
+  state.SetBytesProcessed(state.iterations() * data.size());
+  state.SetItemsProcessed(state.iterations() * count);
+}
+
+// range(2) columns of range(0) values each, like the columns of a row group;
+// their encoded lengths differ
+const std::vector<std::vector<char>> &get_columns(std::size_t len, value_distribution dist, std::size_t columns) {
+  static std::map<std::tuple<std::size_t, value_distribution, std::size_t>, std::vector<std::vector<char>>> all_data;
+  auto &data = all_data[{len, dist, columns}];
+  if (data.empty()) {
+    auto &values = get_values(len * columns, dist);
+    for (std::size_t c = 0; c < columns; ++c) {
+      auto &column = data.emplace_back(len * varint_max_size<uint64_t>);
+      auto end = varint_encoder::encode(std::span{values}.subspan(c * len, len), column.data());
+      column.resize(end - column.data());
+    }
+  }
+  return data;
+}
+
+// The columns decoded one after another with a bulk parser, against
+// BM_interleaved.
+template <auto Fun> void BM_columns(benchmark::State &state) {
+  auto count = static_cast<size_t>(state.range(0));
+  auto &columns = get_columns(count, bench_distribution(state), state.range(2));
+  std::vector<uint64_t> result(count * columns.size());
+  std::size_t bytes = 0;
+  for (auto &column : columns)
+    bytes += column.size();
+
+  varint_bench_counters counters;
+  counters.start();
+  for (auto _ : state) {
+    for (std::size_t c = 0; c < columns.size(); ++c) {
+      auto r = Fun(columns[c].data(), columns[c].data() + columns[c].size(), result.data() + c * count);
+      benchmark::DoNotOptimize(r);
+    }
+  }
+  counters.stop(state, state.iterations() * result.size());
+  state.SetBytesProcessed(state.iterations() * bytes);
+  state.SetItemsProcessed(state.iterations() * result.size());
+}
+
+template <std::size_t Lanes> void BM_interleaved(benchmark::State &state) {
+  auto count = static_cast<size_t>(state.range(0));
+  auto &columns = get_columns(count, bench_distribution(state), state.range(2));
+  std::vector<uint64_t> result(count * columns.size());
+  std::vector<varint_stream> streams(columns.size());
+  std::size_t bytes = 0;
+  for (auto &column : columns)
+    bytes += column.size();
+
+  varint_bench_counters counters;
+  counters.start();
+  for (auto _ : state) {
+    for (std::size_t c = 0; c < columns.size(); ++c)
+      streams[c] = {columns[c].data(), columns[c].data() + columns[c].size(), result.data() + c * count};
+    interleaved_varint_parser<Lanes>::parse(streams);
+    benchmark::DoNotOptimize(streams.data());
+  }
+  counters.stop(state, state.iterations() * result.size());
+  state.SetBytesProcessed(state.iterations() * bytes);
+  state.SetItemsProcessed(state.iterations() * result.size());
+}
+
+// The values of a distribution as the length prefix and payload of a packed
+// field. int32 fields hold negative_int32 sign-extended, the way protobuf
+// writes them.
+const std::vector<char> &get_packed_field(std::size_t len, value_distribution dist) {
+  static std::map<std::pair<std::size_t, value_distribution>, std::vector<char>> all_data;
+  auto &data = all_data[{len, dist}];
+  if (data.empty()) {
+    auto &payload = get_data(len, dist);
+    data.resize(varint_max_size<uint64_t>);
+    std::span<char> prefix{data};
+    pack_varint(uint64_t(payload.size()), prefix);
+    data.resize(data.size() - prefix.size());
+    data.insert(data.end(), payload.begin(), payload.end());
+  }
+  return data;
+}
+
+// Decoding a packed field into a reused vector, against the scalar loop of a
+// generated protobuf parser: one bounds checked varint at a time, appended.
+template <protobuf_varint_type Type, bool Scalar = false> void BM_packed_field(benchmark::State &state) {
+  auto count = static_cast<size_t>(state.range(0));
+  auto &field = get_packed_field(count, bench_distribution(state));
+  const char *end = field.data() + field.size();
+  std::vector<protobuf_value_t<Type>> values;
+
+  varint_bench_counters counters;
+  counters.start();
+  for (auto _ : state) {
+    values.clear();
+    varint_parse_result r;
+    if constexpr (Scalar) {
+      uint64_t length = 0;
+      r = parse_checked_varint(field.data(), end, length);
+      const char *field_end = r.ptr + length;
+      for (const char *p = r.ptr; r.ec == std::errc{} && p < field_end; p = r.ptr) {
+        protobuf_value_t<Type> v;
+        r = parse_checked_varint(p, field_end, v);
+        if (r.ec == std::errc{})
+          values.push_back(v);
+      }
+    } else {
+      r = parse_packed_field<Type>(field.data(), end, values);
+    }
+    if (r.ec != std::errc{} || values.size() != count) [[unlikely]] {
+      state.SkipWithError("malformed packed field");
+      break;
+    }
+    benchmark::DoNotOptimize(values.data());
+  }
+  counters.stop(state, state.iterations() * count);
+  state.SetBytesProcessed(state.iterations() * field.size());
+  state.SetItemsProcessed(state.iterations() * count);
+}
+
+// A message of len fields numbered 1 to 16 in turn. Every 8th field is a
+// length delimited field of up to 255 'x' bytes, the others are varint fields
+// holding the values of a distribution. 16 zero bytes follow, the slop
+// generated parsers read past the end.
+const std::vector<char> &get_message(std::size_t len, value_distribution dist) {
+  static std::map<std::pair<std::size_t, value_distribution>, std::vector<char>> all_data;
+  auto &data = all_data[{len, dist}];
+  if (data.empty()) {
+    auto &values = get_values(len, dist);
+    data.resize(len * 270 + 16);
+    std::span<char> out{data};
+    for (std::size_t i = 0; i < len; ++i) {
+      const uint64_t field_number = i % 16 + 1;
+      if (i % 8 == 7) {
+        pack_varint(field_number << 3 | 2, out);
+        const std::size_t length = values[i] % 256;
+        pack_varint(uint64_t(length), out);
+        std::fill_n(out.begin(), length, 'x');
+        out = out.subspan(length);
+      } else {
+        pack_varint(field_number << 3, out);
+        pack_varint(values[i], out);
+      }
+    }
+    data.resize(data.size() - out.size() + 16);
+  }
+  return data;
+}
+
+// Indexing the fields of a message, against the loop of a generated parser
+// skipping unknown fields: the tag and every varint value decoded with
+// shift_mix_parse_varint. Copying the message is the reference.
+template <int Method> void BM_scan_fields(benchmark::State &state) {
+  auto count = static_cast<size_t>(state.range(0));
+  auto &data = get_message(count, bench_distribution(state));
+  std::span<const char> message{data.data(), data.size() - 16};
+  std::vector<protobuf_field> index;
+  std::vector<char> copy(message.size());
+
+  varint_bench_counters counters;
+  counters.start();
+  for (auto _ : state) {
+    index.clear();
+    if constexpr (Method == 0) {
+      memcpy(copy.data(), message.data(), message.size());
+      benchmark::DoNotOptimize(copy.data());
+    } else if constexpr (Method == 1) {
+      const char *p = message.data();
+      const char *end = message.data() + message.size();
+      while (p < end) {
+        int64_t tag;
+        p = shift_mix_parse_varint<uint64_t>(p, tag);
+        protobuf_field field{static_cast<uint32_t>(uint64_t(tag) >> 3), static_cast<protobuf_wire_type>(tag & 7), 0,
+                             0};
+        int64_t v;
+        const char *value = p;
+        switch (field.wire_type) {
+        case protobuf_wire_type::varint:
+          p = shift_mix_parse_varint<uint64_t>(p, v);
+          break;
+        case protobuf_wire_type::len:
+          value = shift_mix_parse_varint<uint64_t>(p, v);
+          p = value + v;
+          break;
+        case protobuf_wire_type::i64:
+          p += 8;
+          break;
+        case protobuf_wire_type::i32:
+          p += 4;
+          break;
+        default:
+          break;
+        }
+        field.offset = value - message.data();
+        field.length = p - value;
+        index.push_back(field);
+      }
+    } else {
+      scan_protobuf_fields(message, index);
+    }
+    benchmark::DoNotOptimize(index.data());
+  }
+  counters.stop(state, state.iterations() * count);
+  state.SetBytesProcessed(state.iterations() * message.size());
+  state.SetItemsProcessed(state.iterations() * count);
+}
+
+// Records whose lengths are the values of a distribution modulo 512, so
+// most have 2-byte length prefixes and the one_byte ones 1-byte prefixes.
+const std::vector<char> &get_records(std::size_t len, value_distribution dist) {
+  static std::map<std::pair<std::size_t, value_distribution>, std::vector<char>> all_data;
+  auto &data = all_data[{len, dist}];
+  if (data.empty()) {
+    auto &values = get_values(len, dist);
+    data.resize(len * 514);
+    std::span<char> out{data};
+    for (auto v : values) {
+      const std::size_t length = v % 512;
+      pack_varint(uint64_t(length), out);
+      std::fill_n(out.begin(), length, 'x');
+      out = out.subspan(length);
+    }
+    data.resize(data.size() - out.size());
+  }
+  return data;
+}
+
+// Framing records into string_views, against a loop decoding each length with
+// parse_varint_unrolled and checking it against the end.
+template <bool Scalar> void BM_records(benchmark::State &state) {
+  auto count = static_cast<size_t>(state.range(0));
+  auto &data = get_records(count, bench_distribution(state));
+  std::vector<std::string_view> records;
+
+  varint_bench_counters counters;
+  counters.start();
+  for (auto _ : state) {
+    records.clear();
+    if constexpr (Scalar) {
+      std::span<char> rest{const_cast<char *>(data.data()), data.size()};
+      while (!rest.empty()) {
+        uint64_t length;
+        if (parse_varint_unrolled<uint64_t>{}(length, rest) != std::errc{} || length > rest.size())
+          break;
+        records.push_back({rest.data(), length});
+        rest = rest.subspan(length);
+      }
+    } else {
+      parse_varint_records(data, records);
+    }
+    benchmark::DoNotOptimize(records.data());
+  }
+  counters.stop(state, state.iterations() * count);
+  state.SetBytesProcessed(state.iterations() * data.size());
+  state.SetItemsProcessed(state.iterations() * count);
+}
+
+void column_args(benchmark::internal::Benchmark *b) {
+  for (int d = 0; d < static_cast<int>(std::size(value_distributions)); ++d) {
+    if (static_cast<value_distribution>(d) == value_distribution::trace && std::getenv("VARINT_TRACE") == nullptr)
+      continue;
+    for (int count : {100, 1000})
+      for (int columns : {8, 32})
+        b->Args({count, d, columns});
+  }
+}
+
+// columns too long to scan for every lookup
+void index_args(benchmark::internal::Benchmark *b) {
+  for (auto dist : {value_distribution::uniform, value_distribution::zipf, value_distribution::mixed})
+    for (int count : {1000, 1 << 16, 1 << 20})
+      b->Args({count, static_cast<int>(dist)});
+}
+
+#ifdef __x86_64__
+BENCHMARK(BM_fun<bulk_bmi_parse>)->Apply(distribution_args<>);
+BENCHMARK(BM_bmi_mask_length<4>)->Apply(distribution_args<>);
+BENCHMARK(BM_bmi_mask_length<6>)->Apply(distribution_args<>);
+BENCHMARK(BM_bmi_mask_length<7>)->Apply(distribution_args<>);
+BENCHMARK(BM_bmi_mask_length<8>)->Apply(distribution_args<>);
+#endif
+
+BENCHMARK(BM_fun<bulk_shift_mix_parse>)->Apply(distribution_args<>);
+BENCHMARK(BM_fun<bulk_unroll_parse>)->Apply(distribution_args<>);
+BENCHMARK(BM_fun<bulk_ubfx_parse>)->Apply(distribution_args<>);
+
+#ifdef __AVX2__
+BENCHMARK(BM_fun<bulk_masked_vbyte_parse>)->Apply(distribution_args<>);
+#endif
+#ifdef __AVX512BW__
+BENCHMARK(BM_fun<bulk_masked_vbyte512_parse>)->Apply(distribution_args<>);
+#endif
 #ifdef __x86_64__
-BENCHMARK(BM_fun<bulk_bmi_parse>)->Args({10})->Args({100})->Args({300})->Args({1000});
+BENCHMARK(BM_padded<padded_bmi_parse>)->Apply(distribution_args<>);
 #endif
+BENCHMARK(BM_padded<padded_ubfx_parse>)->Apply(distribution_args<>);
 
-BENCHMARK(BM_fun<bulk_shift_mix_parse>)->Args({10})->Args({100})->Args({300})->Args({1000});
-BENCHMARK(BM_fun<bulk_unroll_parse>)->Args({10})->Args({100})->Args({300})->Args({1000});
-BENCHMARK(BM_fun<bulk_ubfx_parse>)->Args({10})->Args({100})->Args({300})->Args({1000});
+BENCHMARK(BM_fun<bulk_checked_ubfx_parse>)->Apply(distribution_args<>);
+#ifdef __AVX2__
+BENCHMARK(BM_fun<bulk_checked_masked_vbyte_parse>)->Apply(distribution_args<>);
+#endif
+BENCHMARK(BM_fun<bulk_ubfx_parse32>)->Apply(uint32_distribution_args);
+#ifdef __AVX2__
+BENCHMARK(BM_fun<bulk_masked_vbyte_parse32>)->Apply(uint32_distribution_args);
+#endif
+BENCHMARK(BM_fun<bulk_checked_ubfx_parse32>)->Apply(uint32_distribution_args);
+BENCHMARK(BM_fun<bulk_varint32_parse>)->Apply(uint32_distribution_args);
+BENCHMARK(BM_fun<bulk_ubfx_parse_int32>)->Apply(int32_distribution_args);
+BENCHMARK(BM_fun<bulk_checked_ubfx_parse_int32>)->Apply(int32_distribution_args);
+BENCHMARK(BM_fun<bulk_varint32_parse_int32>)->Apply(int32_distribution_args);
+
+#ifdef __x86_64__
+BENCHMARK(BM_fun<bulk_bmi_parse_unzigzag>)->Apply(distribution_args<>);
+BENCHMARK(BM_fun<bulk_zigzag_bmi_parse>)->Apply(distribution_args<>);
+#endif
+BENCHMARK(BM_fun<bulk_zigzag_ubfx_parse>)->Apply(distribution_args<>);
+#ifdef __AVX2__
+BENCHMARK(BM_fun<bulk_zigzag_masked_vbyte_parse>)->Apply(distribution_args<>);
+#endif
+#ifdef __x86_64__
+BENCHMARK(BM_fun<bulk_bmi_parse_prefix_sum>)->Apply(distribution_args<>);
+BENCHMARK(BM_fun<bulk_delta_bmi_parse>)->Apply(distribution_args<>);
+#endif
+BENCHMARK(BM_fun<bulk_delta_ubfx_parse>)->Apply(distribution_args<>);
+#ifdef __AVX2__
+BENCHMARK(BM_fun<bulk_delta_masked_vbyte_parse>)->Apply(distribution_args<>);
+#endif
+BENCHMARK(BM_stream_vbyte_decode)->Apply(uint32_distribution_args);
+BENCHMARK(BM_fun<bulk_stream_vbyte_transcode>)->Apply(uint32_distribution_args);
+BENCHMARK(BM_fun<bulk_adaptive_parse>)->Apply(distribution_args<>);
+BENCHMARK(BM_fun<bulk_dispatch_parse>)->Apply(distribution_args<>);
+BENCHMARK(BM_sum_array<&ubfx_varint_parser::parse<uint64_t>>)->Apply(distribution_args<>);
+BENCHMARK(BM_sink<&ubfx_varint_parser::parse<sum_varint_sink<>>, sum_varint_sink<>>)->Apply(distribution_args<>);
+#ifdef __AVX2__
+BENCHMARK(BM_sum_array<&masked_vbyte_parser<32>::parse<uint64_t>>)->Apply(distribution_args<>);
+BENCHMARK(BM_sink<&masked_vbyte_parser<32>::parse<sum_varint_sink<>>, sum_varint_sink<>>)
+    ->Apply(distribution_args<>);
+BENCHMARK(BM_sink<&masked_vbyte_parser<32>::parse<min_max_varint_sink<>>, min_max_varint_sink<>>)
+    ->Apply(distribution_args<>);
+BENCHMARK(BM_sink<&masked_vbyte_parser<32>::parse<greater_varint_sink<>>, greater_varint_sink<>>)
+    ->Apply(distribution_args<>);
+#endif
+BENCHMARK(BM_columns<bulk_shift_mix_parse>)->Apply(column_args);
+BENCHMARK(BM_columns<bulk_unroll_parse>)->Apply(column_args);
+BENCHMARK(BM_columns<bulk_ubfx_parse>)->Apply(column_args);
+#ifdef __AVX2__
+BENCHMARK(BM_columns<bulk_masked_vbyte_parse>)->Apply(column_args);
+#endif
+BENCHMARK(BM_interleaved<1>)->Apply(column_args);
+BENCHMARK(BM_interleaved<4>)->Apply(column_args);
+BENCHMARK(BM_interleaved<8>)->Apply(column_args);
+BENCHMARK(BM_packed_field<protobuf_varint_type::uint64, true>)->Apply(distribution_args<>);
+BENCHMARK(BM_packed_field<protobuf_varint_type::uint64>)->Apply(distribution_args<>);
+BENCHMARK(BM_packed_field<protobuf_varint_type::int32, true>)->Apply(int32_distribution_args);
+BENCHMARK(BM_packed_field<protobuf_varint_type::int32>)->Apply(int32_distribution_args);
+BENCHMARK(BM_scan_fields<0>)->Apply(distribution_args<>);
+BENCHMARK(BM_scan_fields<1>)->Apply(distribution_args<>);
+BENCHMARK(BM_scan_fields<2>)->Apply(distribution_args<>);
+BENCHMARK(BM_records<true>)->Apply(distribution_args<>);
+BENCHMARK(BM_records<false>)->Apply(distribution_args<>);
+BENCHMARK(BM_index_lookup<0>)->Apply(index_args);
+BENCHMARK(BM_index_lookup<32>)->Apply(index_args);
+BENCHMARK(BM_index_lookup<128>)->Apply(index_args);
+BENCHMARK(BM_index_lookup<1024>)->Apply(index_args);
+BENCHMARK(BM_index_build)->Apply(index_args);
 
 BENCHMARK_MAIN();
@@ -0,0 +1,122 @@
+#pragma once
+#include "varint_stats.h"
+
+#include <benchmark/benchmark.h>
+
+#include <array>
+#include <cstdint>
+#include <string>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Hardware counters of the calling thread around a benchmark loop, through
+// perf_event_open(2), reported per item: cycles, instructions, branch misses
+// and L1D / last level cache read misses. That tells a kernel limited by
+// mispredicted branches from one waiting on pext or on memory.
+//
+// Counters the kernel doesn't grant (see /proc/sys/kernel/perf_event_paranoid)
+// or the CPU doesn't have, as in many VMs, are silently left out. Counts are
+// scaled when the kernel multiplexes them. Unlike the --benchmark_perf_counters
+// option of Google Benchmark this needs no libpfm.
+#ifdef __linux__
+constexpr uint64_t perf_cache_read_miss(uint64_t cache) {
+  return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+}
+#endif
+
+class perf_counters {
+#ifdef __linux__
+  struct event {
+    const char *name;
+    uint32_t type;
+    uint64_t config;
+  };
+
+  static constexpr event events[] = {
+      {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+      {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+      {"branch_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+      {"l1d_misses", PERF_TYPE_HW_CACHE, perf_cache_read_miss(PERF_COUNT_HW_CACHE_L1D)},
+      {"llc_misses", PERF_TYPE_HW_CACHE, perf_cache_read_miss(PERF_COUNT_HW_CACHE_LL)},
+  };
+
+  std::array<int, std::size(events)> fds;
+
+public:
+  perf_counters() {
+    for (std::size_t i = 0; i < fds.size(); ++i) {
+      perf_event_attr attr{};
+      attr.size = sizeof(attr);
+      attr.type = events[i].type;
+      attr.config = events[i].config;
+      attr.disabled = 1;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+      fds[i] = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+    }
+  }
+
+  perf_counters(const perf_counters &) = delete;
+  perf_counters &operator=(const perf_counters &) = delete;
+
+  ~perf_counters() {
+    for (int fd : fds)
+      if (fd >= 0)
+        close(fd);
+  }
+
+  void start() {
+    for (int fd : fds) {
+      if (fd >= 0) {
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+      }
+    }
+  }
+
+  // Stops counting and adds the counts divided by items to the counters of
+  // state, e.g. "cycles/item".
+  void stop(benchmark::State &state, uint64_t items) {
+    for (int fd : fds)
+      if (fd >= 0)
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    for (std::size_t i = 0; i < fds.size(); ++i) {
+      uint64_t values[3]; // value, time enabled, time running
+      if (fds[i] < 0 || read(fds[i], values, sizeof(values)) != sizeof(values) || values[2] == 0 || items == 0)
+        continue;
+      const double count = static_cast<double>(values[0]) * values[1] / values[2];
+      state.counters[std::string(events[i].name) + "/item"] = count / items;
+    }
+  }
+#else
+public:
+  void start() {}
+  void stop(benchmark::State &, uint64_t) {}
+#endif
+};
+
+// perf_counters plus, in VARINT_STATS builds, the decoders' slow path hits
+// per item, e.g. "ubfx_tail_varints/item".
+class varint_bench_counters {
+  perf_counters perf;
+
+public:
+  void start() {
+    varint_stats::reset();
+    perf.start();
+  }
+
+  void stop(benchmark::State &state, uint64_t items) {
+    perf.stop(state, items);
+    if constexpr (varint_stats::enabled) {
+      for (int c = 0; c < varint_stats::num_counters; ++c)
+        state.counters[std::string(varint_stats::names[c]) + "/item"] =
+            static_cast<double>(varint_stats::get(static_cast<varint_stats::counter>(c))) / items;
+    }
+  }
+};
@@ -0,0 +1,211 @@
+#pragma once
+#include "checked_varint_parser.h"
+#include "num_varints.h"
+#include "protobuf_wire.h"
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <span>
+#include <system_error>
+#include <vector>
+
+// Field index of a protobuf message without decoding its values, for code
+// that reads a few fields and passes the rest on as bytes. Varint values are
+// skipped by finding their terminator, and length-delimited values by
+// jumping over them; only tags and length prefixes are decoded, the usual
+// single byte ones without looking further.
+//
+// Terminators are found with varint_terminator_mask() over a 64-byte window
+// that is reused until the scan moves past it, so a run of small varint
+// fields costs one vector compare per 64 bytes rather than a branch per byte.
+
+// A field of a message: offset and length are those of its value within the
+// message, after the tag and, for len fields, the length prefix. For groups
+// they cover the fields between the sgroup and egroup tags, which get no
+// entries of their own.
+struct protobuf_field {
+  uint32_t field_number;
+  protobuf_wire_type wire_type;
+  std::size_t offset;
+  std::size_t length;
+};
+
+// The terminator bits of the 64 bytes at base; at the end of the message,
+// of its last bytes followed by continuation bytes.
+struct varint_terminator_window {
+  const char *base;
+  const char *end;
+  uint64_t mask;
+
+  varint_terminator_window(const char *p, const char *e) : end(e) { load(p); }
+
+  void load(const char *p) {
+    base = p;
+    if (end - p >= 64) {
+      mask = varint_terminator_mask(p);
+      return;
+    }
+    alignas(64) char padded[64];
+    memset(padded, 0x80, sizeof(padded));
+    memcpy(padded, p, end - p);
+    mask = varint_terminator_mask(padded);
+  }
+
+  // Length of the varint at p < end, reloading the window if it might end
+  // past it. A varint cut off by end is std::errc::invalid_argument, one
+  // longer than 10 bytes or overflowing 64 bits std::errc::value_too_large.
+  varint_parse_result skip(const char *p) {
+    if (p - base > 64 - 10)
+      load(p);
+    const uint64_t terminators = (mask >> (p - base)) & 0x3ff;
+    if (terminators == 0) [[unlikely]]
+      return {p, end - p < 10 ? std::errc::invalid_argument : std::errc::value_too_large};
+    const int length = std::countr_zero(terminators) + 1;
+    if (length == 10 && uint8_t(p[9]) > 1) [[unlikely]]
+      return {p, std::errc::value_too_large};
+    return {p + length, {}};
+  }
+};
+
+// Decodes the varint at p < end, a tag or length prefix: a single byte
+// directly, longer ones after the window has found their end.
+inline varint_parse_result protobuf_varint_value(const char *p, varint_terminator_window &window, uint64_t &v) {
+  if (int8_t(*p) >= 0) [[likely]] {
+    v = uint8_t(*p);
+    return {p + 1, {}};
+  }
+  const auto r = window.skip(p);
+  if (r.ec != std::errc{})
+    return r;
+  v = 0;
+  for (int shift = 0; p < r.ptr; ++p, shift += 7)
+    v |= uint64_t(uint8_t(*p) & 0x7f) << shift;
+  return r;
+}
+
+// Calls f(const protobuf_field &) for the fields of message in order, until
+// it returns false. On success ptr is the end of the message, or the end of
+// the field f stopped at. Otherwise ptr is at the tag of the malformed field
+// and ec is
+//   - std::errc::invalid_argument when the message ends inside the field;
+//   - std::errc::value_too_large for varints longer than 10 bytes;
+//   - std::errc::result_out_of_range for tags as for parse_protobuf_tag();
+//   - std::errc::bad_message for an egroup tag not closing the open group.
+template <typename F>
+varint_parse_result for_each_protobuf_field(std::span<const char> message, F &&f) {
+  const char *p = message.data();
+  const char *const end = message.data() + message.size();
+  if (p == end)
+    return {p, {}};
+  varint_terminator_window window(p, end);
+
+  // the outermost open group, its tag and how deeply groups are nested
+  protobuf_field group{};
+  const char *group_tag = nullptr;
+  std::size_t depth = 0;
+
+  while (p < end) {
+    const char *const tag_begin = p;
+    uint64_t tag;
+    auto r = protobuf_varint_value(p, window, tag);
+    if (r.ec != std::errc{})
+      return r;
+    if ((tag >> 3) == 0 || (tag >> 3) > (1U << 29) - 1 || (tag & 7) > 5) [[unlikely]]
+      return {tag_begin, std::errc::result_out_of_range};
+    protobuf_field field{static_cast<uint32_t>(tag >> 3), static_cast<protobuf_wire_type>(tag & 7), 0, 0};
+    p = r.ptr;
+
+    switch (field.wire_type) {
+    case protobuf_wire_type::varint:
+      if (p == end)
+        return {tag_begin, std::errc::invalid_argument};
+      r = window.skip(p);
+      if (r.ec != std::errc{})
+        return {tag_begin, r.ec};
+      field.length = r.ptr - p;
+      break;
+    case protobuf_wire_type::i64:
+      field.length = 8;
+      break;
+    case protobuf_wire_type::i32:
+      field.length = 4;
+      break;
+    case protobuf_wire_type::len: {
+      if (p == end)
+        return {tag_begin, std::errc::invalid_argument};
+      uint64_t length;
+      r = protobuf_varint_value(p, window, length);
+      if (r.ec != std::errc{})
+        return {tag_begin, r.ec};
+      p = r.ptr;
+      if (length > static_cast<uint64_t>(end - p))
+        return {tag_begin, std::errc::invalid_argument};
+      field.length = length;
+      break;
+    }
+    case protobuf_wire_type::sgroup:
+      if (depth++ == 0) {
+        group = field;
+        group.offset = p - message.data();
+        group_tag = tag_begin;
+      }
+      continue;
+    case protobuf_wire_type::egroup:
+      if (depth == 0 || (depth == 1 && field.field_number != group.field_number))
+        return {tag_begin, std::errc::bad_message};
+      if (--depth > 0)
+        continue;
+      group.length = (tag_begin - message.data()) - group.offset;
+      if (!f(group))
+        return {p, {}};
+      continue;
+    }
+
+    if (field.length > static_cast<std::size_t>(end - p))
+      return {tag_begin, std::errc::invalid_argument};
+    field.offset = p - message.data();
+    p += field.length;
+    if (depth == 0 && !f(field))
+      return {p, {}};
+  }
+  if (depth > 0)
+    return {group_tag, std::errc::invalid_argument};
+  return {p, {}};
+}
+
+// Appends the fields of message to index. On error, the fields before ptr
+// have been appended. The fields are gathered in batches on the stack, the
+// scan stopping at the end of each batch and resuming after it, as the
+// growth check of a push_back per field costs as much as finding it.
+inline varint_parse_result scan_protobuf_fields(std::span<const char> message, std::vector<protobuf_field> &index) {
+  protobuf_field batch[64];
+  for (std::size_t offset = 0;;) {
+    std::size_t n = 0;
+    const auto r = for_each_protobuf_field(message.subspan(offset), [&](const protobuf_field &field) {
+      batch[n++] = field;
+      return n < std::size(batch);
+    });
+    for (std::size_t i = 0; i < n; ++i)
+      batch[i].offset += offset;
+    index.insert(index.end(), batch, batch + n);
+    offset = r.ptr - message.data();
+    if (r.ec != std::errc{} || offset == message.size())
+      return r;
+  }
+}
+
+// The first field of message numbered field_number, if any; field_number 0
+// when there is none or the message is malformed before it.
+inline protobuf_field find_protobuf_field(std::span<const char> message, uint32_t field_number) {
+  protobuf_field result{};
+  for_each_protobuf_field(message, [&](const protobuf_field &field) {
+    if (field.field_number != field_number)
+      return true;
+    result = field;
+    return false;
+  });
+  return result;
+}
@@ -0,0 +1,141 @@
+#pragma once
+#include "checked_varint_parser.h"
+#include "num_varints.h"
+#include "varint_parser.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <system_error>
+#include <type_traits>
+#include <vector>
+
+// Pieces of the protobuf wire format on top of the varint kernels: tags and
+// packed repeated fields of the varint types. A packed field is a tag with
+// wire type len, a varint byte length and that many bytes of varints.
+
+enum class protobuf_wire_type : uint8_t {
+  varint = 0,
+  i64 = 1,
+  len = 2,
+  sgroup = 3,
+  egroup = 4,
+  i32 = 5,
+};
+
+struct protobuf_tag {
+  uint32_t field_number;
+  protobuf_wire_type wire_type;
+};
+
+// Reads the tag at p. Field number 0, and field numbers and wire types out of
+// range, are std::errc::result_out_of_range.
+inline varint_parse_result parse_protobuf_tag(const char *p, const char *end, protobuf_tag &tag) {
+  uint64_t v;
+  const auto r = parse_checked_varint(p, end, v);
+  if (r.ec != std::errc{})
+    return r;
+  if ((v >> 3) == 0 || (v >> 3) > (1U << 29) - 1 || (v & 7) > 5)
+    return {p, std::errc::result_out_of_range};
+  tag = {static_cast<uint32_t>(v >> 3), static_cast<protobuf_wire_type>(v & 7)};
+  return r;
+}
+
+// The field types whose values are varints, and so can be packed.
+enum class protobuf_varint_type {
+  int32,
+  int64,
+  uint32,
+  uint64,
+  sint32,
+  sint64,
+  enumeration,
+  boolean,
+};
+
+// The C++ type of a field type's values, and how they're decoded: the
+// checked bulk parser on the fastest kernel, decoding into the unsigned
+// counterpart and zigzag decoding on the way for sint32 and sint64. The
+// checked parser's scalar path only produces values for the int32
+// sign-extended encoding of negative numbers, which needs no zigzag. Bools
+// are uint8_t 0 or 1, as std::vector<bool> has no array to decode into.
+template <protobuf_varint_type Type>
+struct packed_varint_decoder {
+  static constexpr bool zigzag = Type == protobuf_varint_type::sint32 || Type == protobuf_varint_type::sint64;
+
+  using value_type = std::conditional_t<
+      Type == protobuf_varint_type::boolean, uint8_t,
+      std::conditional_t<Type == protobuf_varint_type::int32 || Type == protobuf_varint_type::sint32 ||
+                             Type == protobuf_varint_type::enumeration,
+                         int32_t,
+                         std::conditional_t<Type == protobuf_varint_type::uint32, uint32_t,
+                                            std::conditional_t<Type == protobuf_varint_type::uint64, uint64_t,
+                                                               int64_t>>>>;
+  // the type decoded into
+  using decoded_type = std::conditional_t<zigzag, std::make_unsigned_t<value_type>, value_type>;
+  using output = std::conditional_t<zigzag, zigzag_varint_output, raw_varint_output>;
+
+  // Decodes the count varints of [begin, end) to result.
+  static varint_parse_result decode(const char *begin, const char *end, std::size_t count, value_type *result) {
+    if constexpr (Type == protobuf_varint_type::boolean) {
+      // encoders write bools as single bytes
+      if (count == static_cast<std::size_t>(end - begin)) {
+        for (std::size_t i = 0; i < count; ++i)
+          result[i] = begin[i] != 0;
+        return {end, {}};
+      }
+      while (begin < end) {
+        uint64_t v;
+        const auto r = parse_checked_varint(begin, end, v);
+        if (r.ec != std::errc{})
+          return r;
+        *result++ = v != 0;
+        begin = r.ptr;
+      }
+      return {end, {}};
+    } else {
+#ifdef __AVX2__
+      constexpr auto kernel = &masked_vbyte_parser<32, output>::template parse<decoded_type>;
+#else
+      constexpr auto kernel = &basic_ubfx_varint_parser<output>::template parse<decoded_type>;
+#endif
+      return checked_varint_parser<decoded_type, kernel>::parse(begin, end,
+                                                                reinterpret_cast<decoded_type *>(result));
+    }
+  }
+};
+
+template <protobuf_varint_type Type>
+using protobuf_value_t = typename packed_varint_decoder<Type>::value_type;
+
+// Appends the values of the varints in [begin, end), the payload of a packed
+// field, to values. The values are counted first, so values grows once, and
+// are then decoded in one bulk pass over exactly that range. On error, ptr
+// and ec are as for checked_varint_parser; the values before ptr have been
+// appended. Values that don't fit the field type are errors rather than
+// truncated.
+template <protobuf_varint_type Type>
+varint_parse_result parse_packed_varints(const char *begin, const char *end,
+                                         std::vector<protobuf_value_t<Type>> &values) {
+  const std::size_t count = num_varints({begin, end});
+  const std::size_t size = values.size();
+  values.resize(size + count);
+  const auto r = packed_varint_decoder<Type>::decode(begin, end, count, values.data() + size);
+  if (r.ec != std::errc{})
+    values.resize(size + num_varints({begin, r.ptr}));
+  return r;
+}
+
+// Appends the values of the packed field whose length prefix is at p, i.e.
+// right after its tag, to values. On success ptr is the end of the field. A
+// length past end is std::errc::invalid_argument at p.
+template <protobuf_varint_type Type>
+varint_parse_result parse_packed_field(const char *p, const char *end, std::vector<protobuf_value_t<Type>> &values) {
+  uint64_t length;
+  const auto r = parse_checked_varint(p, end, length);
+  if (r.ec != std::errc{})
+    return r;
+  if (length > static_cast<uint64_t>(end - r.ptr))
+    return {p, std::errc::invalid_argument};
+  return parse_packed_varints<Type>(r.ptr, r.ptr + length, values);
+}
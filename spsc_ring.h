@@ -0,0 +1,74 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <vector>
+
+// Lock-free ring buffer between exactly one producer thread and one consumer
+// thread. Each side owns one index and keeps a cached copy of the other's, so
+// the shared cache lines only move when the ring looks full or empty. The
+// blocking push() and pop() wait on the index of the other side with
+// std::atomic::wait.
+template <typename T>
+class spsc_ring {
+  static constexpr std::size_t cache_line = 64;
+
+  std::vector<T> slots;
+  std::size_t mask;
+  alignas(cache_line) std::atomic<std::size_t> head{0}; // next slot to pop, written by the consumer
+  alignas(cache_line) std::size_t cached_tail = 0;      // the consumer's copy of tail
+  alignas(cache_line) std::atomic<std::size_t> tail{0}; // next slot to push, written by the producer
+  alignas(cache_line) std::size_t cached_head = 0;      // the producer's copy of head
+
+public:
+  // capacity is rounded up to a power of two
+  explicit spsc_ring(std::size_t capacity) : slots(std::bit_ceil(std::max<std::size_t>(capacity, 1))) {
+    mask = slots.size() - 1;
+  }
+
+  spsc_ring(const spsc_ring &) = delete;
+  spsc_ring &operator=(const spsc_ring &) = delete;
+
+  std::size_t capacity() const { return slots.size(); }
+
+  bool try_push(T &&value) {
+    const std::size_t t = tail.load(std::memory_order_relaxed);
+    if (t - cached_head == slots.size()) {
+      cached_head = head.load(std::memory_order_acquire);
+      if (t - cached_head == slots.size())
+        return false;
+    }
+    slots[t & mask] = std::move(value);
+    tail.store(t + 1, std::memory_order_release);
+    tail.notify_one();
+    return true;
+  }
+
+  bool try_pop(T &value) {
+    const std::size_t h = head.load(std::memory_order_relaxed);
+    if (h == cached_tail) {
+      cached_tail = tail.load(std::memory_order_acquire);
+      if (h == cached_tail)
+        return false;
+    }
+    value = std::move(slots[h & mask]);
+    head.store(h + 1, std::memory_order_release);
+    head.notify_one();
+    return true;
+  }
+
+  void push(T value) {
+    while (!try_push(std::move(value)))
+      head.wait(cached_head, std::memory_order_acquire);
+  }
+
+  T pop() {
+    T value;
+    while (!try_pop(value))
+      tail.wait(cached_tail, std::memory_order_acquire);
+    return value;
+  }
+};
@@ -0,0 +1,211 @@
+#pragma once
+#include "num_varints.h"
+#include "varint_encoder.h"
+#include "varint_parser.h"
+#include "varint_stream_decoder.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <immintrin.h>
+#include <span>
+#include <utility>
+
+// Stream VByte: an alternative to LEB128 for 32-bit values that don't need to
+// be wire compatible with protobuf. The lengths of four values are packed into
+// a control byte, two bits each holding the number of bytes minus one, and
+// all control bytes precede the little endian value bytes:
+//
+//   [control bytes: (count + 3) / 4][data bytes: 1 to 4 per value]
+//
+// As lengths are known before any data is read, values are decoded without
+// the byte serial dependency of LEB128, four at a time with one pshufb. The
+// format isn't self delimiting, so the decoders are told the value count.
+
+constexpr std::size_t stream_vbyte_max_size(std::size_t count) {
+  return (count + 3) / 4 + count * sizeof(uint32_t);
+}
+
+#ifdef __AVX2__
+// Per control byte shuffles: decode spreads the data bytes of four values into
+// 32-bit lanes and encode gathers them back; length is their total size.
+struct stream_vbyte_table {
+  std::array<std::array<uint8_t, 16>, 256> decode;
+  std::array<std::array<uint8_t, 16>, 256> encode;
+  std::array<uint8_t, 256> length;
+
+  static const stream_vbyte_table &get() {
+    static const stream_vbyte_table table;
+    return table;
+  }
+
+private:
+  stream_vbyte_table() {
+    for (int control = 0; control < 256; ++control) {
+      decode[control].fill(0x80);
+      encode[control].fill(0x80);
+      int pos = 0;
+      for (int lane = 0; lane < 4; ++lane) {
+        const int bytes = ((control >> (2 * lane)) & 3) + 1;
+        for (int b = 0; b < bytes; ++b, ++pos) {
+          decode[control][lane * 4 + b] = pos;
+          encode[control][pos] = lane * 4 + b;
+        }
+      }
+      length[control] = pos;
+    }
+  }
+};
+#endif
+
+struct stream_vbyte_encoder {
+  static inline char *encode_one(uint32_t value, uint8_t &control, int lane, char *data) {
+    const int bytes = value < (1U << 8) ? 1 : value < (1U << 16) ? 2 : value < (1U << 24) ? 3 : 4;
+    control |= (bytes - 1) << (2 * lane);
+    memcpy(data, &value, sizeof(value));
+    return data + bytes;
+  }
+
+  // Writes values to separate control and data streams; except for the last
+  // call on a stream, values.size() must be a multiple of 4. Up to 16 bytes
+  // past the end of the data written may be overwritten, which is never more
+  // than stream_vbyte_max_size() accounts for.
+  static char *encode(std::span<const uint32_t> values, uint8_t *control, char *data) {
+    auto p = values.data();
+    auto end = p + values.size();
+#ifdef __AVX2__
+    const auto &table = stream_vbyte_table::get();
+    for (; end - p >= 4; p += 4) {
+      const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+      // each lane holds bytes - 1: the number of thresholds it reaches
+      const auto reaches = [&](uint32_t threshold) {
+        const __m128i t = _mm_set1_epi32(threshold);
+        return _mm_cmpeq_epi32(_mm_min_epu32(v, t), t);
+      };
+      const __m128i codes = _mm_sub_epi32(
+          _mm_setzero_si128(),
+          _mm_add_epi32(_mm_add_epi32(reaches(1U << 8), reaches(1U << 16)), reaches(1U << 24)));
+      // gather the low byte of each lane, then move the four codes next to
+      // each other in the top byte with a multiplication
+      const uint32_t packed =
+          _mm_cvtsi128_si32(_mm_shuffle_epi8(codes, _mm_set1_epi32(0x0c080400)));
+      const uint8_t c = static_cast<uint8_t>((packed * 0x01041040U) >> 24);
+      *control++ = c;
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(data),
+                       _mm_shuffle_epi8(v, _mm_loadu_si128(reinterpret_cast<const __m128i *>(
+                                               table.encode[c].data()))));
+      data += table.length[c];
+    }
+#else
+    for (; end - p >= 4; p += 4) {
+      uint8_t c = 0;
+      for (int lane = 0; lane < 4; ++lane)
+        data = encode_one(p[lane], c, lane, data);
+      *control++ = c;
+    }
+#endif
+    if (p != end) {
+      uint8_t c = 0;
+      for (int lane = 0; p != end; ++lane)
+        data = encode_one(*p++, c, lane, data);
+      *control = c;
+    }
+    return data;
+  }
+
+  // Encodes values to out, which must have room for
+  // stream_vbyte_max_size(values.size()) bytes. Returns the end of the output.
+  static char *encode(std::span<const uint32_t> values, char *out) {
+    auto control = reinterpret_cast<uint8_t *>(out);
+    return encode(values, control, out + (values.size() + 3) / 4);
+  }
+};
+
+struct stream_vbyte_decoder {
+  // Decodes count values from control and data streams, see encode() above
+  // for the multiple of 4 requirement. Returns the end of the data read; data
+  // is read up to data_end, never past it.
+  static const char *decode(const uint8_t *control, const char *data, const char *data_end,
+                            std::size_t count, uint32_t *result) {
+    auto result_end = result + count;
+#ifdef __AVX2__
+    const auto &table = stream_vbyte_table::get();
+    for (; result_end - result >= 8 && data_end - data >= 32; result += 8) {
+      const uint8_t c0 = *control++;
+      const uint8_t c1 = *control++;
+      const __m128i lo = _mm_shuffle_epi8(
+          _mm_loadu_si128(reinterpret_cast<const __m128i *>(data)),
+          _mm_loadu_si128(reinterpret_cast<const __m128i *>(table.decode[c0].data())));
+      data += table.length[c0];
+      const __m128i hi = _mm_shuffle_epi8(
+          _mm_loadu_si128(reinterpret_cast<const __m128i *>(data)),
+          _mm_loadu_si128(reinterpret_cast<const __m128i *>(table.decode[c1].data())));
+      data += table.length[c1];
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(result), _mm256_set_m128i(hi, lo));
+    }
+#endif
+    for (int lane = 0; result != result_end; ++result, lane = (lane + 1) % 4) {
+      const int bytes = ((*control >> (2 * lane)) & 3) + 1;
+      uint32_t value = 0;
+      memcpy(&value, data, bytes);
+      *result = value;
+      data += bytes;
+      if (lane == 3)
+        ++control;
+    }
+    return data;
+  }
+
+  // Decodes count values from the stream at [begin, end). Returns the end of
+  // the stream.
+  static const char *decode(const char *begin, const char *end, std::size_t count, uint32_t *result) {
+    auto control = reinterpret_cast<const uint8_t *>(begin);
+    return decode(control, begin + (count + 3) / 4, end, count, result);
+  }
+};
+
+// Conversion between LEB128 varints and Stream VByte, through a block of
+// decoded values small enough to stay in L1.
+struct stream_vbyte_transcoder {
+  static constexpr std::size_t block_size = 256;
+
+  // Converts the varints in [begin, end), whose values must fit in 32 bits, to
+  // Stream VByte at out, which must have room for stream_vbyte_max_size() of
+  // their count. Returns the end of the output and the number of values.
+  static std::pair<char *, std::size_t> from_varints(const char *begin, const char *end, char *out) {
+    const std::size_t count = num_varints({begin, end});
+    auto control = reinterpret_cast<uint8_t *>(out);
+    char *data = out + (count + 3) / 4;
+    alignas(32) uint32_t values[block_size];
+    for (std::size_t done = 0; done < count; done += block_size) {
+      const std::size_t n = std::min(block_size, count - done);
+      const char *block_end = find_varint_terminators(begin, end, n).first;
+#ifdef __AVX2__
+      masked_vbyte_parser<32>::parse(begin, block_end, values);
+#else
+      ubfx_varint_parser::parse(begin, block_end, values);
+#endif
+      begin = block_end;
+      data = stream_vbyte_encoder::encode(std::span<const uint32_t>(values, n), control, data);
+      control += n / 4;
+    }
+    return {data, count};
+  }
+
+  // Converts count values of the Stream VByte stream at [begin, end) to
+  // varints at out, which must have room for count * varint_max_size<uint32_t>
+  // bytes. Returns the end of the output.
+  static char *to_varints(const char *begin, const char *end, std::size_t count, char *out) {
+    auto control = reinterpret_cast<const uint8_t *>(begin);
+    const char *data = begin + (count + 3) / 4;
+    alignas(32) uint32_t values[block_size];
+    for (std::size_t done = 0; done < count; done += block_size) {
+      const std::size_t n = std::min(block_size, count - done);
+      data = stream_vbyte_decoder::decode(control, data, end, n, values);
+      control += n / 4;
+      out = varint_encoder::encode(std::span<const uint32_t>(values, n), out);
+    }
+    return out;
+  }
+};
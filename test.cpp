@@ -1,8 +1,31 @@
 #include "parse_varint.h"
 #include "varint_parser.h"
+#include "varint_encoder.h"
+#include "varint_dispatch.h"
+#include "parallel_varint_parser.h"
+#include "varint_stream_decoder.h"
+#include "checked_varint_parser.h"
+#include "varint32_parser.h"
+#include "stream_vbyte.h"
+#include "adaptive_varint_parser.h"
+#include "num_varints.h"
+#include "varint_index.h"
+#include "varint_sinks.h"
+#include "varint_file.h"
+#include "varint_pipeline.h"
+#include "interleaved_varint_parser.h"
+#include "protobuf_wire.h"
+#include "protobuf_scanner.h"
+#include "varint_records.h"
 
 #include <boost/ut.hpp>
 
+#include <csignal>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <thread>
+
 using namespace boost::ut;
 
 suite varint_test = []
@@ -31,4 +54,1677 @@ suite varint_test = []
 
 };
 
+template <typename Type>
+std::vector<char> pack_varints(const std::vector<Type> &values)
+{
+    std::vector<char> result(values.size() * varint_max_size<Type>);
+    std::span<char> data{result};
+    for (auto v : values)
+        pack_varint(v, data);
+    result.resize(result.size() - data.size());
+    return result;
+}
+
+// a mix of every encoded length, long enough to exercise the vector loops and tails
+template <typename Type>
+std::vector<Type> mixed_length_values(std::size_t count)
+{
+    std::vector<Type> values;
+    uint64_t x = 0x9e3779b97f4a7c15ULL;
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        auto bits = (i % 5 == 0) ? x % 64 : x % 15;
+        values.push_back(static_cast<Type>(x >> (63 - bits)));
+    }
+    return values;
+}
+
+suite bulk_parser_test = []
+{
+    auto verify = [](auto parse, const auto &values)
+    {
+        auto data = pack_varints(values);
+        std::remove_cvref_t<decltype(values)> result(values.size());
+        auto end = parse(data.data(), data.data() + data.size(), result.data());
+        expect(end == data.data() + data.size());
+        expect(result == values);
+    };
+
+#ifdef __BMI2__
+    "bmi_mask_length"_test = [&]
+    {
+        auto verify_mask_length = [&]<int MaskLength>()
+        {
+            auto parse = [](auto begin, auto end, auto *result)
+            {
+                bmi_varint_parser<MaskLength, std::remove_pointer_t<decltype(result)>> parser;
+                return parser.parse(begin, end, result);
+            };
+            for (std::size_t count : {1, 10, 100, 1000})
+            {
+                verify(parse, mixed_length_values<uint64_t>(count));
+                verify(parse, mixed_length_values<uint32_t>(count));
+                verify(parse, std::vector<uint64_t>(count, 1));
+                verify(parse, std::vector<uint64_t>(count, UINT64_MAX));
+            }
+        };
+        verify_mask_length.template operator()<4>();
+        verify_mask_length.template operator()<6>();
+        verify_mask_length.template operator()<7>();
+        verify_mask_length.template operator()<8>();
+    };
+#endif
+    // a varint of 11 bytes, in the vector loop and in the tail, is end + 1 as
+    // for ubfx_varint_parser
+    auto verify_too_long = [](auto parse)
+    {
+        for (std::size_t prefix : {std::size_t{0}, std::size_t{3}, std::size_t{100}})
+        {
+            std::vector<char> data(prefix, 1);
+            data.insert(data.end(), 10, char(0x80));
+            data.push_back(1);
+            for (std::size_t suffix : {std::size_t{0}, std::size_t{64}})
+            {
+                auto padded = data;
+                padded.resize(data.size() + suffix, 1);
+                std::vector<uint64_t> result(padded.size());
+                const char *end = padded.data() + padded.size();
+                expect(parse(padded.data(), end, result.data()) == end + 1);
+            }
+        }
+    };
+
+    "ubfx_too_long"_test = [&]
+    {
+        verify_too_long([](auto... args) { return ubfx_varint_parser::parse(args...); });
+    };
+
+#ifdef __AVX2__
+    "masked_vbyte"_test = [&]
+    {
+        for (std::size_t count : {1, 10, 100, 1000})
+        {
+            verify([](auto... args) { return masked_vbyte_parser<32>::parse(args...); }, mixed_length_values<uint64_t>(count));
+            verify([](auto... args) { return masked_vbyte_parser<32>::parse(args...); }, mixed_length_values<uint32_t>(count));
+            verify([](auto... args) { return masked_vbyte_parser<32>::parse(args...); }, std::vector<uint64_t>(count, 1));
+        }
+        verify_too_long([](auto... args) { return masked_vbyte_parser<32>::parse(args...); });
+    };
+#endif
+#ifdef __AVX512BW__
+    "masked_vbyte512"_test = [&]
+    {
+        verify([](auto... args) { return masked_vbyte_parser<64>::parse(args...); }, mixed_length_values<uint64_t>(1000));
+        verify([](auto... args) { return masked_vbyte_parser<64>::parse(args...); }, std::vector<uint32_t>(1000, 127));
+        verify_too_long([](auto... args) { return masked_vbyte_parser<64>::parse(args...); });
+    };
+#endif
+};
+
+suite encoder_test = []
+{
+    auto verify = [](auto encode, const auto &values)
+    {
+        using value_type = typename std::remove_cvref_t<decltype(values)>::value_type;
+        auto expected = pack_varints(values);
+        std::vector<char> result(values.size() * varint_max_size<value_type>);
+        auto end = encode(std::span<const value_type>{values}, result.data());
+        result.resize(end - result.data());
+        expect(result == expected);
+    };
+
+    auto verify_all = [&](auto encode)
+    {
+        for (std::size_t count : {0, 1, 3, 10, 100, 1000})
+        {
+            verify(encode, mixed_length_values<uint64_t>(count));
+            verify(encode, mixed_length_values<uint32_t>(count));
+            verify(encode, mixed_length_values<int64_t>(count));
+            verify(encode, mixed_length_values<int32_t>(count));
+            verify(encode, mixed_length_values<uint16_t>(count));
+            verify(encode, mixed_length_values<uint8_t>(count));
+        }
+    };
+
+    "pdep"_test = [&]
+    {
+        verify_all([](auto in, char *out) { return pdep_varint_encoder::encode(in, out); });
+    };
+
+#ifdef __AVX2__
+    "avx2"_test = [&]
+    {
+        verify_all([](auto in, char *out) { return avx2_varint_encoder::encode(in, out); });
+    };
+#endif
+#if defined(__AVX512BW__) && defined(__AVX512VBMI2__)
+    "avx512"_test = [&]
+    {
+        verify_all([](auto in, char *out) { return avx512_varint_encoder::encode(in, out); });
+    };
+#endif
+
+    "varint_size"_test = []
+    {
+        expect(varint_size(0) == 1);
+        for (int bits = 1; bits <= 64; ++bits)
+        {
+            const uint64_t v = bits == 64 ? ~0ULL : (1ULL << bits) - 1;
+            expect(varint_size(v) == (bits + 6) / 7);
+            expect(varint_size(v >> 1 | v >> (bits - 1) << (bits - 1)) == (bits + 6) / 7);
+        }
+    };
+
+    // the sizes against the output of the encoder, through each input stage
+    auto verify_sizer = [](auto sizer)
+    {
+        auto verify = [&](const auto &values, auto stage)
+        {
+            using value_type = typename std::remove_cvref_t<decltype(values)>::value_type;
+            const std::span<const value_type> in{values};
+            std::vector<char> encoded(values.size() * varint_max_size<value_type>);
+            const auto encoded_bytes = std::size_t(pdep_varint_encoder::encode(in, encoded.data(), stage) - encoded.data());
+            expect(sizer.encoded_size(in, stage) == encoded_bytes);
+
+            std::vector<uint8_t> sizes(values.size());
+            sizer.encoded_sizes(in, sizes.data(), stage);
+            std::vector<uint8_t> expected;
+            for (auto v : values)
+                expected.push_back(uint8_t(varint_size(stage(v))));
+            expect(sizes == expected);
+        };
+        for (std::size_t count : {0, 1, 7, 9, 100, 1000})
+        {
+            verify(mixed_length_values<uint64_t>(count), raw_varint_input{});
+            verify(mixed_length_values<uint32_t>(count), raw_varint_input{});
+            verify(mixed_length_values<int32_t>(count), raw_varint_input{});
+            verify(mixed_length_values<uint16_t>(count), raw_varint_input{});
+            verify(mixed_length_values<uint8_t>(count), raw_varint_input{});
+            verify(mixed_length_values<int64_t>(count), zigzag_varint_input{});
+            verify(mixed_length_values<int32_t>(count), zigzag_varint_input{});
+            verify(mixed_length_values<uint64_t>(count), delta_varint_input<>{});
+        }
+    };
+
+    "sizer"_test = [&]
+    {
+        verify_sizer(scalar_varint_sizer{});
+#ifdef __AVX2__
+        verify_sizer(avx2_varint_sizer{});
+#endif
+#if defined(__AVX512F__) && defined(__AVX512CD__)
+        verify_sizer(avx512_varint_sizer{});
+#endif
+        const std::vector<uint64_t> values{0, 127, 128, ~0ULL};
+        expect(encoded_size(std::span<const uint64_t>{values}) == 1 + 1 + 2 + 10);
+    };
+};
+
+suite dispatch_test = []
+{
+    "decoders"_test = []
+    {
+        auto values = mixed_length_values<uint64_t>(1000);
+        auto data = pack_varints(values);
+        expect(!supported_varint_decoders().empty());
+        for (const auto &decoder : supported_varint_decoders())
+        {
+            std::vector<uint64_t> result(values.size());
+            auto end = decoder.parse(data.data(), data.data() + data.size(), result.data());
+            expect(end == data.data() + data.size()) << decoder.name;
+            expect(result == values) << decoder.name;
+        }
+    };
+
+    "counters"_test = []
+    {
+        auto data = pack_varints(mixed_length_values<uint64_t>(1000));
+        for (std::size_t size : {0, 1, 7, 8, 63, 64, 65, 1000})
+        {
+            std::span<const char> range{data.data(), size};
+            auto expected = std::count_if(range.begin(), range.end(), [](char c) { return int8_t(c) >= 0; });
+            for (const auto &counter : supported_varint_counters())
+                expect(counter.count(range) == std::size_t(expected)) << counter.name;
+        }
+        expect(dispatch_count_varints(data) == 1000);
+    };
+
+    "num_varints"_test = []
+    {
+        auto data = pack_varints(mixed_length_values<uint64_t>(1000));
+        for (std::size_t size : {0, 1, 7, 8, 31, 32, 127, 128, 255, 256, 300, 1000})
+        {
+            std::span<const char> range{data.data(), size};
+            auto expected = std::size_t(std::count_if(range.begin(), range.end(), [](char c) { return int8_t(c) >= 0; }));
+            expect(num_varints_unroll1(range) == expected);
+            expect(count_num_varints_by_dword(range) == expected);
+#if __has_include(<experimental/simd>)
+            expect(num_varints_simd(range) == expected);
+#endif
+#ifdef __AVX2__
+            expect(num_varints_avx2(range) == expected);
+#endif
+#ifdef __AVX512BW__
+            expect(num_varints_avx512(range) == expected);
+#endif
+            expect(num_varints(range) == expected);
+        }
+    };
+};
+
+suite parallel_test = []
+{
+    "split"_test = []
+    {
+        auto data = pack_varints(mixed_length_values<uint64_t>(1000));
+        for (std::size_t num_chunks : {1, 2, 7, 64, 5000})
+        {
+            auto chunks = split_at_varint_boundaries(data, num_chunks);
+            expect(chunks.size() <= num_chunks);
+            expect(chunks.front().data() == data.data());
+            expect(chunks.back().data() + chunks.back().size() == data.data() + data.size());
+            for (std::size_t i = 0; i < chunks.size(); ++i)
+            {
+                expect(!chunks[i].empty());
+                expect(int8_t(chunks[i].back()) >= 0);
+                if (i > 0)
+                    expect(chunks[i].data() == chunks[i - 1].data() + chunks[i - 1].size());
+            }
+        }
+    };
+
+    "parse"_test = []
+    {
+        for (std::size_t count : {0, 1, 100, 10000})
+        {
+            auto values = mixed_length_values<uint64_t>(count);
+            auto data = pack_varints(values);
+            for (unsigned num_threads : {1, 3, 8})
+            {
+                auto partition = partition_varints(data, num_threads);
+                expect(partition.count == count);
+                std::vector<uint64_t> result(partition.count);
+                parallel_parse_varints(partition, result.data());
+                expect(result == values);
+            }
+        }
+    };
+};
+
+suite stream_decoder_test = []
+{
+    // feeds data in chunks of chunk_size bytes, draining at most out_size values at a time
+    auto decode = [](const std::vector<char> &data, std::size_t chunk_size, std::size_t out_size)
+    {
+        varint_stream_decoder<uint64_t> decoder;
+        std::vector<uint64_t> result;
+        std::vector<uint64_t> buffer(out_size);
+        for (std::size_t pos = 0; pos < data.size(); pos += chunk_size)
+        {
+            std::span<const char> input{data.data() + pos, std::min(chunk_size, data.size() - pos)};
+            while (!input.empty())
+            {
+                std::span<uint64_t> output{buffer};
+                expect(decoder.decode(input, output) == std::errc{});
+                result.insert(result.end(), buffer.begin(), buffer.end() - output.size());
+            }
+        }
+        expect(!decoder.has_partial());
+        return result;
+    };
+
+    "chunks"_test = [&]
+    {
+        auto values = mixed_length_values<uint64_t>(1000);
+        auto data = pack_varints(values);
+        for (std::size_t chunk_size : {1, 3, 10, 64, 4096})
+        {
+            for (std::size_t out_size : {1, 7, 2000})
+                expect(decode(data, chunk_size, out_size) == values);
+        }
+    };
+
+    "overlong"_test = []
+    {
+        std::vector<char> data(11, char(0x80));
+        data.push_back(1);
+        varint_stream_decoder<uint64_t> decoder;
+        std::vector<uint64_t> buffer(4);
+        std::span<const char> first{data.data(), 5}, second{data.data() + 5, data.size() - 5};
+        std::span<uint64_t> output{buffer};
+        expect(decoder.decode(first, output) == std::errc{});
+        expect(first.empty());
+        expect(decoder.has_partial());
+        expect(decoder.decode(second, output) == std::errc::value_too_large);
+        expect(second.data() == data.data() + 10);
+    };
+
+    "overlong_in_chunk"_test = []
+    {
+        auto values = mixed_length_values<uint64_t>(100);
+        auto data = pack_varints(values);
+        std::size_t bad = data.size() / 2;
+        while (int8_t(data[bad - 1]) < 0)
+            ++bad;
+        const auto before = std::size_t(std::count_if(data.begin(), data.begin() + bad,
+                                                      [](char c) { return int8_t(c) >= 0; }));
+        data.insert(data.begin() + bad, 10, char(0x80));
+        data.insert(data.begin() + bad + 10, char(1));
+        auto verify = [&]<auto Parse>()
+        {
+            varint_stream_decoder<uint64_t, Parse> decoder;
+            std::vector<uint64_t> buffer(values.size() + 1);
+            std::span<const char> input{data};
+            std::span<uint64_t> output{buffer};
+            expect(decoder.decode(input, output) == std::errc::value_too_large);
+            expect(input.data() == data.data() + bad);
+            expect(output.data() == buffer.data() + before);
+            expect(std::equal(buffer.data(), output.data(), values.begin()));
+        };
+        verify.template operator()<&ubfx_varint_parser::parse<uint64_t>>();
+#ifdef __AVX2__
+        verify.template operator()<&masked_vbyte_parser<32>::parse<uint64_t>>();
+#endif
+    };
+};
+
+suite checked_parser_test = []
+{
+    auto parse = [](const std::vector<char> &data, auto &result)
+    {
+        using value_type = typename std::remove_cvref_t<decltype(result)>::value_type;
+        result.resize(data.size());
+        auto r = checked_varint_parser<value_type>::parse(data.data(), data.data() + data.size(), result.data());
+        return std::pair{r.ptr - data.data(), r.ec};
+    };
+
+    "valid"_test = [&]
+    {
+        for (std::size_t count : {0, 1, 10, 100, 10000})
+        {
+            auto values = mixed_length_values<uint64_t>(count);
+            auto data = pack_varints(values);
+            std::vector<uint64_t> result;
+            expect(parse(data, result) == std::pair{std::ptrdiff_t(data.size()), std::errc{}});
+            result.resize(values.size());
+            expect(result == values);
+        }
+    };
+
+    // errors are planted after `prefix` valid values, which may cross a segment
+    for (std::size_t prefix : {0, 5, 3000})
+    {
+        auto values = mixed_length_values<uint64_t>(prefix);
+        auto data = pack_varints(values);
+        const std::ptrdiff_t offset = data.size();
+
+        "truncated"_test = [=]
+        {
+            auto input = data;
+            input.insert(input.end(), {char(0x80), char(0x80)});
+            std::vector<uint64_t> result;
+            expect(parse(input, result) == std::pair{offset, std::errc::invalid_argument});
+            result.resize(values.size());
+            expect(result == values);
+        };
+
+        "overlong"_test = [=]
+        {
+            auto input = data;
+            input.insert(input.end(), 10, char(0x80));
+            input.insert(input.end(), 70, 1);
+            std::vector<uint64_t> result;
+            expect(parse(input, result) == std::pair{offset, std::errc::value_too_large});
+        };
+
+        "out_of_range"_test = [=]
+        {
+            auto input = data;
+            input.insert(input.end(), 9, char(0xff));
+            input.insert(input.end(), 70, 2);
+            std::vector<uint64_t> result;
+            expect(parse(input, result) == std::pair{offset, std::errc::result_out_of_range});
+        };
+
+        "int32"_test = [=]
+        {
+            auto input = pack_varints(std::vector<int32_t>(prefix, 100));
+            auto negative = pack_varints(std::vector<int64_t>{-1, INT32_MIN});
+            input.insert(input.end(), negative.begin(), negative.end());
+            std::vector<int32_t> result;
+            expect(parse(input, result) == std::pair{std::ptrdiff_t(input.size()), std::errc{}});
+            expect(result[prefix] == -1 && result[prefix + 1] == INT32_MIN);
+
+            const std::ptrdiff_t end = input.size();
+            auto too_large = pack_varints(std::vector<int64_t>{INT32_MIN - 1LL, 1});
+            input.insert(input.end(), too_large.begin(), too_large.end());
+            expect(parse(input, result) == std::pair{end, std::errc::result_out_of_range});
+        };
+
+        "uint32"_test = [=]
+        {
+            auto input = pack_varints(std::vector<uint32_t>(prefix, UINT32_MAX));
+            const std::ptrdiff_t end = input.size();
+            auto too_large = pack_varints(std::vector<uint64_t>{1ULL << 32, 1});
+            input.insert(input.end(), too_large.begin(), too_large.end());
+            std::vector<uint32_t> result;
+            expect(parse(input, result) == std::pair{end, std::errc::result_out_of_range});
+            expect(std::all_of(result.begin(), result.begin() + prefix, [](auto v) { return v == UINT32_MAX; }));
+        };
+    }
+};
+
+suite padded_test = []
+{
+    "buffer"_test = []
+    {
+        for (bool huge_pages : {false, true})
+        {
+            varint_buffer<64, 64> buffer(100, huge_pages);
+            expect(reinterpret_cast<uintptr_t>(buffer.data()) % 64 == 0);
+            std::fill(buffer.begin(), buffer.end(), char(0xff));
+            buffer.resize(10);
+            expect(std::all_of(buffer.end(), buffer.end() + 64, [](char c) { return c == 0; }));
+            buffer.resize(5000);
+            expect(std::all_of(buffer.begin(), buffer.begin() + 10, [](char c) { return c == char(0xff); }));
+            expect(std::all_of(buffer.begin() + 10, buffer.end() + 64, [](char c) { return c == 0; }));
+        }
+    };
+
+    auto verify = [](auto parse, const auto &values)
+    {
+        const varint_buffer<> data(pack_varints(values));
+        // values must not be written past the decoded ones
+        std::remove_cvref_t<decltype(values)> result(values.size() + 64, 42);
+        auto end = parse(data, result.data());
+        expect(end == data.end());
+        expect(std::equal(values.begin(), values.end(), result.begin()));
+        expect(std::all_of(result.begin() + values.size(), result.end(), [](auto v) { return v == 42; }));
+    };
+
+    for (std::size_t count : {0, 1, 3, 10, 100, 1000})
+    {
+        auto values = mixed_length_values<uint64_t>(count);
+        auto small_values = std::vector<uint64_t>(count, 3);
+        "ubfx"_test = [=]
+        {
+            verify([](auto &data, auto *result) { return ubfx_varint_parser::parse(data, result); }, values);
+            verify([](auto &data, auto *result) { return ubfx_varint_parser::parse(data, result); }, small_values);
+        };
+#ifdef __BMI2__
+        "bmi"_test = [=]
+        {
+            verify([](auto &data, auto *result) { return bmi_varint_parser<6, uint64_t>{}.parse(data, result); }, values);
+            verify([](auto &data, auto *result) { return bmi_varint_parser<6, uint64_t>{}.parse(data, result); }, small_values);
+        };
+#endif
+    }
+};
+
+template <typename Type>
+std::vector<std::make_unsigned_t<Type>> zigzag_values(const std::vector<Type> &values)
+{
+    std::vector<std::make_unsigned_t<Type>> result;
+    for (auto v : values)
+        result.push_back(zigzag_encode(v));
+    return result;
+}
+
+suite zigzag_test = []
+{
+    "mapping"_test = []
+    {
+        static_assert(zigzag_encode<int32_t>(0) == 0);
+        static_assert(zigzag_encode<int32_t>(-1) == 1);
+        static_assert(zigzag_encode<int32_t>(1) == 2);
+        static_assert(zigzag_encode<int32_t>(INT32_MIN) == UINT32_MAX);
+        static_assert(zigzag_encode<int64_t>(INT64_MAX) == UINT64_MAX - 1);
+        static_assert(zigzag_decode<int32_t>(UINT32_MAX) == INT32_MIN);
+        static_assert(zigzag_decode<int64_t>(UINT64_MAX - 1) == INT64_MAX);
+        static_assert(zigzag_decode<int64_t>(3) == -2);
+    };
+
+    auto verify = [](auto parse, const auto &values)
+    {
+        auto data = pack_varints(zigzag_values(values));
+        std::remove_cvref_t<decltype(values)> result(values.size());
+        auto end = parse(data.data(), data.data() + data.size(), result.data());
+        expect(end == data.data() + data.size());
+        expect(result == values);
+    };
+
+    auto verify_all = [&](auto parse)
+    {
+        for (std::size_t count : {1, 10, 100, 1000})
+        {
+            auto values = mixed_length_values<int64_t>(count);
+            values.insert(values.end(), {-1, 1, INT64_MIN, INT64_MAX});
+            verify(parse, values);
+            verify(parse, mixed_length_values<int32_t>(count));
+            verify(parse, std::vector<int64_t>(count, -3));
+        }
+    };
+
+    "ubfx"_test = [&]
+    {
+        verify_all([](auto... args) { return basic_ubfx_varint_parser<zigzag_varint_output>::parse(args...); });
+    };
+#ifdef __BMI2__
+    "bmi"_test = [&]
+    {
+        verify_all([](auto begin, auto end, auto *result)
+                   { return bmi_varint_parser<6, std::remove_pointer_t<decltype(result)>, zigzag_varint_output>{}.parse(begin, end, result); });
+    };
+#endif
+#ifdef __AVX2__
+    "masked_vbyte"_test = [&]
+    {
+        verify_all([](auto... args) { return masked_vbyte_parser<32, zigzag_varint_output>::parse(args...); });
+    };
+#endif
+#ifdef __AVX512BW__
+    "masked_vbyte512"_test = [&]
+    {
+        verify_all([](auto... args) { return masked_vbyte_parser<64, zigzag_varint_output>::parse(args...); });
+    };
+#endif
+
+    auto verify_encoder = [](auto encode)
+    {
+        auto check = [&](const auto &values)
+        {
+            using value_type = typename std::remove_cvref_t<decltype(values)>::value_type;
+            auto expected = pack_varints(zigzag_values(values));
+            std::vector<char> result(values.size() * varint_max_size<value_type>);
+            auto end = encode(std::span<const value_type>{values}, result.data());
+            result.resize(end - result.data());
+            expect(result == expected);
+        };
+        for (std::size_t count : {0, 1, 3, 10, 100, 1000})
+        {
+            auto values = mixed_length_values<int64_t>(count);
+            values.insert(values.end(), {-1, 1, INT64_MIN, INT64_MAX});
+            check(values);
+            check(mixed_length_values<int32_t>(count));
+            check(mixed_length_values<int16_t>(count));
+            check(mixed_length_values<int8_t>(count));
+        }
+    };
+
+    "pdep_encoder"_test = [&]
+    {
+        verify_encoder([](auto in, char *out) { return pdep_varint_encoder::encode<zigzag_varint_input>(in, out); });
+    };
+#ifdef __AVX2__
+    "avx2_encoder"_test = [&]
+    {
+        verify_encoder([](auto in, char *out) { return avx2_varint_encoder::encode<zigzag_varint_input>(in, out); });
+    };
+#endif
+#if defined(__AVX512BW__) && defined(__AVX512VBMI2__)
+    "avx512_encoder"_test = [&]
+    {
+        verify_encoder([](auto in, char *out) { return avx512_varint_encoder::encode<zigzag_varint_input>(in, out); });
+    };
+#endif
+};
+
+template <typename Type>
+std::vector<Type> delta_values(const std::vector<Type> &values)
+{
+    using U = std::make_unsigned_t<Type>;
+    std::vector<Type> result;
+    U prev = 0;
+    for (auto v : values)
+    {
+        result.push_back(static_cast<Type>(static_cast<U>(U(v) - prev)));
+        prev = U(v);
+    }
+    return result;
+}
+
+// a sorted sequence whose gaps mostly take 1 or 2 bytes, like a posting list
+template <typename Type>
+std::vector<Type> sorted_values(std::size_t count)
+{
+    auto gaps = mixed_length_values<uint16_t>(count);
+    std::vector<Type> values;
+    Type sum = 0;
+    for (auto gap : gaps)
+        values.push_back(sum += gap % 1000);
+    return values;
+}
+
+suite delta_test = []
+{
+    auto verify = [](auto parse, const auto &values)
+    {
+        using value_type = typename std::remove_cvref_t<decltype(values)>::value_type;
+        std::vector<char> data;
+        if constexpr (std::is_signed_v<value_type>)
+            data = pack_varints(zigzag_values(delta_values(values)));
+        else
+            data = pack_varints(delta_values(values));
+        std::remove_cvref_t<decltype(values)> result(values.size());
+        auto end = parse(data.data(), data.data() + data.size(), result.data());
+        expect(end == data.data() + data.size());
+        expect(result == values);
+    };
+
+    auto verify_all = [&](auto parse)
+    {
+        for (std::size_t count : {1, 10, 100, 1000})
+        {
+            verify(parse, sorted_values<uint64_t>(count));
+            verify(parse, sorted_values<uint32_t>(count));
+            verify(parse, mixed_length_values<uint64_t>(count));
+            verify(parse, mixed_length_values<int64_t>(count));
+            verify(parse, mixed_length_values<int32_t>(count));
+        }
+    };
+
+    // unsigned values are decoded with plain deltas, signed ones with zigzag deltas
+    auto stage = []<typename T>(T *) {
+        if constexpr (std::is_signed_v<T>)
+            return delta_varint_output<zigzag_varint_output>{};
+        else
+            return delta_varint_output<>{};
+    };
+
+    "ubfx"_test = [&]
+    {
+        verify_all([&](auto begin, auto end, auto *result)
+                   {
+                       auto s = stage(result);
+                       return ubfx_varint_parser::parse(begin, end, result, s);
+                   });
+    };
+#ifdef __BMI2__
+    "bmi"_test = [&]
+    {
+        verify_all([&](auto begin, auto end, auto *result)
+                   {
+                       bmi_varint_parser<6, std::remove_pointer_t<decltype(result)>, decltype(stage(result))> parser;
+                       return parser.parse(begin, end, result);
+                   });
+    };
+#endif
+#ifdef __AVX2__
+    "masked_vbyte"_test = [&]
+    {
+        verify_all([&](auto begin, auto end, auto *result)
+                   {
+                       auto s = stage(result);
+                       return masked_vbyte_parser<32>::parse(begin, end, result, s);
+                   });
+    };
+#endif
+#ifdef __AVX512BW__
+    "masked_vbyte512"_test = [&]
+    {
+        verify_all([&](auto begin, auto end, auto *result)
+                   {
+                       auto s = stage(result);
+                       return masked_vbyte_parser<64>::parse(begin, end, result, s);
+                   });
+    };
+#endif
+
+    "resume"_test = []
+    {
+        auto values = sorted_values<uint64_t>(1000);
+        auto data = pack_varints(delta_values(values));
+        auto split = data.data() + data.size() / 2;
+        while (int8_t(split[-1]) < 0)
+            ++split;
+        auto count = std::count_if(data.data(), split, [](char c) { return int8_t(c) >= 0; });
+
+        std::vector<uint64_t> result(values.size());
+        delta_varint_output<> stage;
+        ubfx_varint_parser::parse(data.data(), split, result.data(), stage);
+        expect(stage.base == values[count - 1]);
+        ubfx_varint_parser::parse(split, data.data() + data.size(), result.data() + count, stage);
+        expect(result == values);
+    };
+
+    auto verify_encoder = [](auto encode)
+    {
+        auto check = [&](const auto &values)
+        {
+            using value_type = typename std::remove_cvref_t<decltype(values)>::value_type;
+            std::vector<char> expected;
+            std::vector<char> result(values.size() * varint_max_size<value_type>);
+            char *end;
+            if constexpr (std::is_signed_v<value_type>)
+            {
+                expected = pack_varints(zigzag_values(delta_values(values)));
+                end = encode(std::span<const value_type>{values}, result.data(), delta_varint_input<zigzag_varint_input>{});
+            }
+            else
+            {
+                expected = pack_varints(delta_values(values));
+                end = encode(std::span<const value_type>{values}, result.data(), delta_varint_input<>{});
+            }
+            result.resize(end - result.data());
+            expect(result == expected);
+        };
+        for (std::size_t count : {0, 1, 3, 10, 100, 1000})
+        {
+            check(sorted_values<uint64_t>(count));
+            check(sorted_values<uint32_t>(count));
+            check(mixed_length_values<uint64_t>(count));
+            check(mixed_length_values<int64_t>(count));
+            check(mixed_length_values<int32_t>(count));
+            check(mixed_length_values<int16_t>(count));
+        }
+    };
+
+    "pdep_encoder"_test = [&]
+    {
+        verify_encoder([](auto in, char *out, auto stage) { return pdep_varint_encoder::encode(in, out, stage); });
+    };
+#ifdef __AVX2__
+    "avx2_encoder"_test = [&]
+    {
+        verify_encoder([](auto in, char *out, auto stage) { return avx2_varint_encoder::encode(in, out, stage); });
+    };
+#endif
+#if defined(__AVX512BW__) && defined(__AVX512VBMI2__)
+    "avx512_encoder"_test = [&]
+    {
+        verify_encoder([](auto in, char *out, auto stage) { return avx512_varint_encoder::encode(in, out, stage); });
+    };
+#endif
+};
+
+suite varint32_test = []
+{
+    auto parse = [](const std::vector<char> &data, auto &result)
+    {
+        using value_type = typename std::remove_cvref_t<decltype(result)>::value_type;
+        result.resize(data.size());
+        auto r = varint32_parser<value_type>::parse(data.data(), data.data() + data.size(), result.data());
+        return std::pair{r.ptr - data.data(), r.ec};
+    };
+
+    // int32 fields as protobuf writes them: negative values sign-extended to 10 bytes
+    auto pack_int32 = [](const std::vector<int32_t> &values)
+    {
+        return pack_varints(std::vector<int64_t>(values.begin(), values.end()));
+    };
+
+    for (std::size_t count : {0, 1, 10, 100, 1000})
+    {
+        "uint32"_test = [=]
+        {
+            auto values = mixed_length_values<uint32_t>(count);
+            values.insert(values.end(), 40, 7);
+            values.push_back(UINT32_MAX);
+            auto data = pack_varints(values);
+            std::vector<uint32_t> result;
+            expect(parse(data, result) == std::pair{std::ptrdiff_t(data.size()), std::errc{}});
+            result.resize(values.size());
+            expect(result == values);
+        };
+
+        "int32"_test = [=]
+        {
+            auto values = mixed_length_values<int32_t>(count);
+            values.insert(values.end(), {-1, INT32_MIN, INT32_MAX, 0});
+            for (const auto &data : {pack_int32(values), pack_varints(values)})
+            {
+                std::vector<int32_t> result;
+                expect(parse(data, result) == std::pair{std::ptrdiff_t(data.size()), std::errc{}});
+                result.resize(values.size());
+                expect(result == values);
+            }
+        };
+    }
+
+    for (std::size_t prefix : {0, 5, 300})
+    {
+        auto values = mixed_length_values<int32_t>(prefix);
+        auto data = pack_int32(values);
+        const std::ptrdiff_t offset = data.size();
+        auto with = [&](std::vector<char> tail)
+        {
+            auto input = data;
+            input.insert(input.end(), tail.begin(), tail.end());
+            input.insert(input.end(), 20, 1);
+            return input;
+        };
+
+        "errors"_test = [=]
+        {
+            std::vector<int32_t> result;
+            expect(parse(with(pack_varints(std::vector<int64_t>{INT32_MIN - 1LL})), result) ==
+                   std::pair{offset, std::errc::result_out_of_range});
+            result.resize(values.size());
+            expect(result == values);
+            expect(parse(with(pack_varints(std::vector<uint64_t>{1ULL << 32})), result) ==
+                   std::pair{offset, std::errc::result_out_of_range});
+            expect(parse(with(std::vector<char>(11, char(0x80))), result) ==
+                   std::pair{offset, std::errc::value_too_large});
+
+            auto unsigned_input = pack_varints(mixed_length_values<uint32_t>(prefix));
+            const std::ptrdiff_t unsigned_offset = unsigned_input.size();
+            auto negative = pack_varints(std::vector<int64_t>{-1, 1});
+            unsigned_input.insert(unsigned_input.end(), negative.begin(), negative.end());
+            std::vector<uint32_t> unsigned_result;
+            expect(parse(unsigned_input, unsigned_result) == std::pair{unsigned_offset, std::errc::result_out_of_range});
+
+            auto truncated = data;
+            truncated.insert(truncated.end(), {char(0xff), char(0xff)});
+            expect(parse(truncated, result) == std::pair{offset, std::errc::invalid_argument});
+        };
+
+        "overlong"_test = [=]
+        {
+            // 7 bytes for the value 1, which fits
+            auto input = with({char(0x81), char(0x80), char(0x80), char(0x80), char(0x80), char(0x80), 0});
+            std::vector<int32_t> result;
+            expect(parse(input, result) == std::pair{std::ptrdiff_t(input.size()), std::errc{}});
+            expect(result[values.size()] == 1);
+        };
+    }
+};
+
+suite stream_vbyte_test = []
+{
+    "layout"_test = []
+    {
+        const std::vector<uint32_t> values{1, 0x100, 0x10000, 0x1000000, 5};
+        std::vector<char> data(stream_vbyte_max_size(values.size()));
+        auto end = stream_vbyte_encoder::encode(values, data.data());
+        const std::vector<uint8_t> expected{0xe4, 0x00, 1, 0, 1, 0, 0, 1, 0, 0, 0, 1, 5};
+        expect(std::vector<uint8_t>(data.data(), end) == expected);
+    };
+
+    for (std::size_t count : {0, 1, 3, 4, 5, 9, 100, 1000})
+    {
+        auto values = mixed_length_values<uint32_t>(count);
+        values.insert(values.end(), 40, 7);
+        values.push_back(UINT32_MAX);
+
+        "round_trip"_test = [=]
+        {
+            std::vector<char> data(stream_vbyte_max_size(values.size()));
+            auto end = stream_vbyte_encoder::encode(values, data.data());
+            std::vector<uint32_t> result(values.size());
+            expect(stream_vbyte_decoder::decode(data.data(), end, values.size(), result.data()) == end);
+            expect(result == values);
+        };
+
+        "transcode"_test = [=]
+        {
+            auto varints = pack_varints(values);
+            std::vector<char> data(stream_vbyte_max_size(values.size()));
+            auto [end, n] = stream_vbyte_transcoder::from_varints(varints.data(), varints.data() + varints.size(),
+                                                                  data.data());
+            expect(n == values.size());
+            std::vector<uint32_t> result(values.size());
+            expect(stream_vbyte_decoder::decode(data.data(), end, n, result.data()) == end);
+            expect(result == values);
+
+            std::vector<char> back(values.size() * varint_max_size<uint32_t>);
+            auto back_end = stream_vbyte_transcoder::to_varints(data.data(), end, n, back.data());
+            back.resize(back_end - back.data());
+            expect(back == varints);
+        };
+    }
+};
+
+suite adaptive_test = []
+{
+    "histogram"_test = []
+    {
+        // 3 varints of 1 byte, 2 of 2, 1 of 10 and one of 5 across a block boundary
+        std::vector<uint64_t> values{1, 2, 3, 300, 400, UINT64_MAX};
+        auto data = pack_varints(values);
+        const std::size_t zeros = 64 - 2 - data.size();
+        data.insert(data.begin(), zeros, 0);
+        auto tail = pack_varints(std::vector<uint64_t>{1ULL << 30});
+        data.insert(data.end(), tail.begin(), tail.end());
+        varint_length_histogram h(data.data(), data.data() + data.size());
+        expect(h.counts[0] == 3 + zeros);
+        expect(h.counts[1] == 2);
+        expect(h.counts[4] == 1);
+        expect(h.counts[9] == 1);
+        expect(h.total() == varint_length_histogram::count(data.data(), data.data() + data.size()));
+    };
+
+    "shape"_test = []
+    {
+        auto shape = [](const std::vector<uint64_t> &values)
+        {
+            auto data = pack_varints(values);
+            return varint_cost_model::shape_of(varint_length_histogram(data.data(), data.data() + data.size()));
+        };
+        expect(shape(std::vector<uint64_t>(100, 1)) == 0);
+        expect(shape(std::vector<uint64_t>(100, 300)) == 2 * varint_cost_model::long_buckets);
+        // one in 10 has 10 bytes: a mean of 1.9 bytes
+        std::vector<uint64_t> values(100, 1);
+        for (std::size_t i = 0; i < values.size(); i += 10)
+            values[i] = UINT64_MAX;
+        expect(shape(values) == varint_cost_model::long_buckets + 2);
+        expect(shape(std::vector<uint64_t>(100, UINT64_MAX)) == varint_cost_model::num_shapes - 1);
+    };
+
+    "parse"_test = []
+    {
+        // quick calibration; the choices don't matter for the results
+        varint_cost_model model(256, 1);
+        adaptive_varint_parser<> parser(model);
+        // parts of different shapes, longer than resample_bytes together
+        auto values = mixed_length_values<uint64_t>(30000);
+        values.insert(values.end(), 100000, 5);
+        auto more = mixed_length_values<uint64_t>(1000);
+        values.insert(values.end(), more.begin(), more.end());
+        auto data = pack_varints(values);
+        std::vector<uint64_t> result(values.size());
+        expect(parser.parse(data.data(), data.data() + data.size(), result.data()) == data.data() + data.size());
+        expect(result == values);
+    };
+};
+
+suite index_test = []
+{
+    "skip"_test = []
+    {
+        auto values = mixed_length_values<uint64_t>(1000);
+        auto data = pack_varints(values);
+        const char *begin = data.data(), *end = data.data() + data.size();
+        const char *p = begin;
+        for (std::size_t i = 0; i <= values.size(); ++i)
+        {
+            expect(skip_varints(begin, end, i) == std::pair{p, i});
+            if (i < values.size())
+                p += varint_size(values[i]);
+        }
+        // fewer varints than asked for, and a cut off one at the end
+        expect(skip_varints(begin, end, 2000) == std::pair{end, values.size()});
+        expect(skip_varints(begin, end - 1, 2000).second == values.size() - 1);
+    };
+
+    "lookup"_test = []
+    {
+        auto values = mixed_length_values<uint64_t>(1000);
+        auto data = pack_varints(values);
+        for (std::size_t stride : {1, 3, 64, 128, 1000, 5000})
+        {
+            varint_index<> index(data, stride);
+            expect(index.size() == values.size());
+            expect(index.num_checkpoints() == (values.size() + stride - 1) / stride);
+            for (std::size_t i = 0; i < values.size(); i += 7)
+            {
+                uint64_t v = 0;
+                expect(index.at(i, v) == std::errc{} && v == values[i]);
+            }
+            uint64_t v;
+            expect(index.at(values.size(), v) == std::errc::result_out_of_range);
+            expect(index.find(values.size()) == data.data() + data.size());
+
+            std::vector<uint64_t> result(300);
+            expect(index.read(500, 300, result.data()) == 300);
+            expect(std::equal(result.begin(), result.end(), values.begin() + 500));
+            expect(index.read(900, 300, result.data()) == 100);
+            expect(std::equal(result.begin(), result.begin() + 100, values.begin() + 900));
+        }
+        varint_index<> empty(std::span<const char>{});
+        expect(empty.size() == 0 && empty.find(0) == nullptr);
+    };
+};
+
+suite sink_test = []
+{
+    auto verify = [](auto parse, const auto &values)
+    {
+        using T = typename std::remove_cvref_t<decltype(values)>::value_type;
+        using U = std::make_unsigned_t<T>;
+        // signed values are zigzag encoded
+        using stage_type = std::conditional_t<std::is_signed_v<T>, zigzag_varint_output, raw_varint_output>;
+        std::vector<char> data;
+        if constexpr (std::is_signed_v<T>)
+            data = pack_varints(zigzag_values(values));
+        else
+            data = pack_varints(values);
+        auto begin = data.data(), end = data.data() + data.size();
+
+        sum_varint_sink<T> sum;
+        expect(parse(begin, end, &sum, stage_type{}) == end);
+        uint64_t expected_sum = 0;
+        for (auto v : values)
+            expected_sum += static_cast<uint64_t>(static_cast<typename sum_varint_sink<T>::sum_type>(v));
+        expect(sum.count == values.size());
+        expect(static_cast<uint64_t>(sum.sum()) == expected_sum);
+
+        min_max_varint_sink<T> min_max;
+        expect(parse(begin, end, &min_max, stage_type{}) == end);
+        expect(min_max.count == values.size());
+        expect(min_max.min() == *std::min_element(values.begin(), values.end()));
+        expect(min_max.max() == *std::max_element(values.begin(), values.end()));
+
+        bit_width_histogram_varint_sink<T> histogram;
+        expect(parse(begin, end, &histogram, stage_type{}) == end);
+        decltype(histogram.counts) expected_counts{};
+        for (auto v : values)
+            ++expected_counts[std::bit_width(U(v))];
+        expect(histogram.counts == expected_counts);
+
+        const T threshold = values[values.size() / 2];
+        std::vector<uint32_t> selection(values.size());
+        greater_varint_sink<T> greater(threshold, selection.data());
+        expect(parse(begin, end, &greater, stage_type{}) == end);
+        selection.resize(greater.selection - selection.data());
+        std::vector<uint32_t> expected_selection;
+        for (std::size_t i = 0; i < values.size(); ++i)
+            if (values[i] > threshold)
+                expected_selection.push_back(uint32_t(i));
+        expect(selection == expected_selection);
+    };
+
+    auto verify_all = [&](auto parse)
+    {
+        for (std::size_t count : {1, 10, 100, 1000})
+        {
+            verify(parse, mixed_length_values<uint64_t>(count));
+            verify(parse, mixed_length_values<uint32_t>(count));
+            verify(parse, mixed_length_values<int64_t>(count));
+            verify(parse, mixed_length_values<int32_t>(count));
+            verify(parse, sorted_values<uint32_t>(count));
+        }
+    };
+
+    "ubfx"_test = [&]
+    {
+        verify_all([](auto begin, auto end, auto *sink, auto stage)
+                   { return ubfx_varint_parser::parse(begin, end, sink, stage); });
+    };
+#ifdef __BMI2__
+    "bmi"_test = [&]
+    {
+        verify_all([](auto begin, auto end, auto *sink, auto stage)
+                   {
+                       bmi_varint_parser<6, std::remove_pointer_t<decltype(sink)>, decltype(stage)> parser;
+                       return parser.parse(begin, end, sink);
+                   });
+    };
+#endif
+#ifdef __AVX2__
+    "masked_vbyte"_test = [&]
+    {
+        verify_all([](auto begin, auto end, auto *sink, auto stage)
+                   { return masked_vbyte_parser<32>::parse(begin, end, sink, stage); });
+    };
+#endif
+#ifdef __AVX512BW__
+    "masked_vbyte512"_test = [&]
+    {
+        verify_all([](auto begin, auto end, auto *sink, auto stage)
+                   { return masked_vbyte_parser<64>::parse(begin, end, sink, stage); });
+    };
+#endif
+
+    "delta"_test = []
+    {
+        // the running sums reach the sink in order
+        auto values = sorted_values<uint64_t>(1000);
+        auto data = pack_varints(delta_values(values));
+        sum_varint_sink<> sum;
+        delta_varint_output<> stage;
+#ifdef __AVX2__
+        masked_vbyte_parser<32>::parse(data.data(), data.data() + data.size(), &sum, stage);
+#else
+        ubfx_varint_parser::parse(data.data(), data.data() + data.size(), &sum, stage);
+#endif
+        expect(sum.sum() == std::accumulate(values.begin(), values.end(), uint64_t{0}));
+    };
+};
+
+suite file_test = []
+{
+    "decode_blocks"_test = []
+    {
+        auto values = mixed_length_values<uint64_t>(10000);
+        auto data = pack_varints(values);
+        const auto path = std::filesystem::temp_directory_path() / "varint_file_test.bin";
+        std::ofstream(path, std::ios::binary).write(data.data(), data.size());
+
+        for (bool populate : {false, true})
+        {
+            const mapped_varint_file file(path.c_str(), {.populate = populate});
+            expect(file.size() == data.size());
+            std::vector<uint64_t> result;
+            auto stop = decode_varint_blocks(
+                file, dispatch_parse_varints,
+                [&](std::span<const uint64_t> block) { result.insert(result.end(), block.begin(), block.end()); },
+                1000);
+            expect(stop == file.data() + file.size());
+            expect(result == values);
+        }
+
+        // a trailing incomplete varint stops decoding at its start
+        std::ofstream(path, std::ios::binary | std::ios::app).put(char(0x81));
+        const mapped_varint_file file(path.c_str());
+        std::size_t count = 0;
+        auto stop = decode_varint_blocks(file, dispatch_parse_varints,
+                                         [&](std::span<const uint64_t> block) { count += block.size(); });
+        expect(stop == file.data() + data.size());
+        expect(count == values.size());
+        std::filesystem::remove(path);
+
+        expect(throws([&] { mapped_varint_file missing(path.c_str()); }));
+    };
+
+    "too_long"_test = []
+    {
+        // an 11-byte varint stops every kernel at its start, after the
+        // varints before it
+        auto data = pack_varints(mixed_length_values<uint64_t>(1000));
+        const std::size_t bad = data.size();
+        data.insert(data.end(), 10, char(0x80));
+        data.push_back(1);
+        auto tail = pack_varints(mixed_length_values<uint64_t>(1000));
+        data.insert(data.end(), tail.begin(), tail.end());
+
+        for (const auto &decoder : supported_varint_decoders())
+        {
+            std::size_t count = 0;
+            auto stop = decode_varint_blocks(
+                data, decoder.parse, [&](std::span<const uint64_t> block) { count += block.size(); }, 1000);
+            expect(stop == data.data() + bad);
+            expect(count == 1000);
+        }
+        expect(!varints_fit_64_bits(data.data(), data.data() + data.size()));
+        std::size_t count = 0;
+        expect(varints_fit_64_bits(data.data(), data.data() + bad, count));
+        expect(count == 1000);
+    };
+};
+
+#ifdef __BMI2__
+// bmi_varint_parser on its own decodes over-long varints without an error
+const char *parse_bmi_varints(const char *begin, const char *end, uint64_t *result)
+{
+    bmi_varint_parser<6, uint64_t> parser;
+    return parser.parse(begin, end, result);
+}
+#endif
+
+suite pipeline_test = []
+{
+    // writes data to a pipe in odd-sized pieces from another thread and
+    // decodes the read end; the writer gets EPIPE when decoding stops early
+    auto decode_pipe = []<auto Parse = &ubfx_varint_parser::parse<uint64_t>>(std::span<const char> data,
+                                                                            varint_pipeline_options options)
+    {
+        std::signal(SIGPIPE, SIG_IGN);
+        int fds[2];
+        expect(pipe(fds) == 0);
+        std::jthread writer([&, fd = fds[1]]
+        {
+            for (std::size_t i = 0, n = 1; i < data.size(); i += n, n = n % 97 + 13)
+                (void)!write(fd, data.data() + i, std::min(n, data.size() - i));
+            close(fd);
+        });
+
+        std::mutex mutex;
+        std::vector<std::vector<uint64_t>> chunks;
+        auto result = decode_varint_pipeline<Parse>(
+            fds[0],
+            [&](std::size_t sequence, std::span<const uint64_t> values)
+            {
+                std::lock_guard lock(mutex);
+                if (chunks.size() <= sequence)
+                    chunks.resize(sequence + 1);
+                chunks[sequence].assign(values.begin(), values.end());
+            },
+            options);
+        close(fds[0]);
+        writer.join();
+
+        std::vector<uint64_t> values;
+        for (const auto &chunk : chunks)
+            values.insert(values.end(), chunk.begin(), chunk.end());
+        return std::pair{result, values};
+    };
+
+    "ring"_test = []
+    {
+        spsc_ring<int> ring(3);
+        expect(ring.capacity() == 4);
+        std::jthread producer([&]
+        {
+            for (int i = 1; i <= 10000; ++i)
+                ring.push(i);
+        });
+        bool ordered = true;
+        for (int i = 1; i <= 10000; ++i)
+            ordered = ordered && ring.pop() == i;
+        expect(ordered);
+        int value;
+        expect(!ring.try_pop(value));
+    };
+
+    "decode"_test = [&]
+    {
+        auto values = mixed_length_values<uint64_t>(20000);
+        auto data = pack_varints(values);
+        for (unsigned workers : {1U, 3U})
+        {
+            auto [result, decoded] = decode_pipe(data, {.chunk_bytes = 100, .workers = workers, .depth = 2});
+            expect(result.ec == std::errc{});
+            expect(result.bytes == data.size());
+            expect(result.varints == values.size());
+            expect(decoded == values);
+        }
+    };
+
+    "errors"_test = [&]
+    {
+        auto values = mixed_length_values<uint64_t>(1000);
+        auto data = pack_varints(values);
+        data.push_back(char(0x81));
+        auto [truncated, decoded] = decode_pipe(data, {.chunk_bytes = 64, .workers = 2});
+        expect(truncated.ec == std::errc::invalid_argument);
+        expect(decoded == values);
+
+        data.assign(20, char(0x80));
+        expect(decode_pipe(data, {.chunk_bytes = 64}).first.ec == std::errc::value_too_large);
+
+        // an 11-byte varint inside a chunk, given to kernels that don't check
+        data = pack_varints(values);
+        data.insert(data.begin() + 10, 10, char(0x80));
+        data.insert(data.begin() + 20, char(1));
+#ifdef __BMI2__
+        expect(decode_pipe.template operator()<&parse_bmi_varints>(data, {.chunk_bytes = 256}).first.ec ==
+               std::errc::value_too_large);
+#endif
+#ifdef __AVX2__
+        expect(decode_pipe.template operator()<&masked_vbyte_parser<32>::parse<uint64_t>>(
+                   data, {.chunk_bytes = 256}).first.ec == std::errc::value_too_large);
+#endif
+
+        // and far into the input, with several workers: every chunk before
+        // the one holding it is consumed, and reading stops soon after it
+        values = mixed_length_values<uint64_t>(20000);
+        data = pack_varints(values);
+        std::size_t bad = data.size() / 4;
+        while (int8_t(data[bad - 1]) < 0)
+            ++bad;
+        const auto before = std::size_t(std::count_if(data.begin(), data.begin() + bad,
+                                                      [](char c) { return int8_t(c) >= 0; }));
+        data.insert(data.begin() + bad, 10, char(0x80));
+        data.insert(data.begin() + bad + 10, char(1));
+        for (unsigned workers : {2U, 3U})
+        {
+            auto [result, decoded] = decode_pipe(data, {.chunk_bytes = 100, .workers = workers, .depth = 2});
+            expect(result.ec == std::errc::value_too_large);
+            expect(result.bytes < data.size());
+            // chunks hold at most 100 varints
+            const auto prefix = std::mismatch(decoded.begin(), decoded.end(), values.begin(), values.end());
+            expect(std::size_t(prefix.first - decoded.begin()) + 100 >= before);
+            expect(result.varints + 100 >= before);
+        }
+    };
+};
+
+suite interleaved_test = []
+{
+    "columns"_test = []
+    {
+        // columns of different lengths, some of them shorter than a burst
+        std::vector<std::vector<uint64_t>> values;
+        std::vector<std::vector<char>> data;
+        for (std::size_t count : {1000, 0, 3, 997, 40, 1000, 512, 1, 2000, 10, 77})
+        {
+            values.push_back(mixed_length_values<uint64_t>(count));
+            data.push_back(pack_varints(values.back()));
+        }
+        auto verify = [&]<std::size_t Lanes>()
+        {
+            std::vector<std::vector<uint64_t>> result;
+            std::vector<varint_stream> streams;
+            for (auto &column : data)
+                result.emplace_back(column.size());
+            for (std::size_t i = 0; i < data.size(); ++i)
+                streams.push_back({data[i].data(), data[i].data() + data[i].size(), result[i].data()});
+            interleaved_varint_parser<Lanes>::parse(streams);
+            for (std::size_t i = 0; i < data.size(); ++i)
+            {
+                expect(streams[i].ec == std::errc{});
+                expect(streams[i].begin == data[i].data() + data[i].size());
+                expect(std::vector<uint64_t>(result[i].data(), streams[i].result) == values[i]);
+            }
+        };
+        verify.operator()<1>();
+        verify.operator()<4>();
+        verify.operator()<8>();
+    };
+
+    "errors"_test = []
+    {
+        auto values = mixed_length_values<uint64_t>(500);
+        auto good = pack_varints(values);
+        auto truncated = good;
+        truncated.push_back(char(0x81));
+        auto overlong = good;
+        overlong.insert(overlong.end(), 11, char(0x80));
+        overlong.insert(overlong.end(), good.begin(), good.end());
+        auto out_of_range = good;
+        out_of_range.insert(out_of_range.end(), 9, char(0xff));
+        out_of_range.push_back(2);
+        out_of_range.insert(out_of_range.end(), good.begin(), good.end());
+
+        std::vector<uint64_t> result[4];
+        std::vector<varint_stream> streams;
+        for (auto *column : {&good, &truncated, &overlong, &out_of_range})
+        {
+            auto &out = result[streams.size()];
+            out.resize(column->size());
+            streams.push_back({column->data(), column->data() + column->size(), out.data()});
+        }
+        interleaved_varint_parser<4>::parse(streams);
+        const std::errc expected[] = {std::errc{}, std::errc::invalid_argument, std::errc::value_too_large,
+                                      std::errc::result_out_of_range};
+        for (std::size_t i = 0; i < 4; ++i)
+        {
+            expect(streams[i].ec == expected[i]);
+            expect(streams[i].begin == streams[i].end - (i == 0 ? 0 : i == 1 ? 1 : good.size() + 10 + (i == 2)));
+            expect(std::vector<uint64_t>(result[i].data(), streams[i].result) == values);
+        }
+    };
+};
+
+suite protobuf_test = []
+{
+    // a packed field of values the way protobuf encoders write them, after a
+    // tag; int32 and enum values are sign-extended to 64 bits
+    auto packed_field = [](uint32_t field_number, const auto &values, auto encode)
+    {
+        std::vector<char> payload(values.size() * 10 + 20);
+        std::span<char> out{payload};
+        for (auto v : values)
+            pack_varint(encode(v), out);
+        payload.resize(payload.size() - out.size());
+
+        std::vector<char> field(40);
+        std::span<char> header{field};
+        pack_varint(uint64_t(field_number) << 3 | 2, header);
+        pack_varint(uint64_t(payload.size()), header);
+        field.resize(field.size() - header.size());
+        field.insert(field.end(), payload.begin(), payload.end());
+        return field;
+    };
+
+    auto verify = [&]<protobuf_varint_type Type>(const auto &values, auto encode)
+    {
+        for (std::size_t count : {std::size_t{0}, std::size_t{1}, std::size_t{33}, values.size()})
+        {
+            count = std::min(count, values.size());
+            const std::vector<protobuf_value_t<Type>> expected(values.begin(), values.begin() + count);
+            auto field = packed_field(7, expected, encode);
+            const char *end = field.data() + field.size();
+
+            protobuf_tag tag{};
+            auto r = parse_protobuf_tag(field.data(), end, tag);
+            expect(r.ec == std::errc{});
+            expect(tag.field_number == 7 && tag.wire_type == protobuf_wire_type::len);
+
+            // the values are appended, as for a field repeated in a message
+            std::vector<protobuf_value_t<Type>> decoded{expected.begin(), expected.begin() + count / 2};
+            r = parse_packed_field<Type>(r.ptr, end, decoded);
+            expect(r.ec == std::errc{});
+            expect(r.ptr == end);
+            expect(std::equal(decoded.begin() + count / 2, decoded.end(), expected.begin(), expected.end()));
+        }
+    };
+
+    "types"_test = [&]
+    {
+        auto raw = [](auto v) { return uint64_t(int64_t(v)); };
+        auto zigzag = [](auto v) { return uint64_t(zigzag_encode(v)); };
+        verify.operator()<protobuf_varint_type::int32>(mixed_length_values<int32_t>(1000), raw);
+        verify.operator()<protobuf_varint_type::int64>(mixed_length_values<int64_t>(1000), raw);
+        verify.operator()<protobuf_varint_type::uint32>(mixed_length_values<uint32_t>(1000), raw);
+        verify.operator()<protobuf_varint_type::uint64>(mixed_length_values<uint64_t>(1000), raw);
+        verify.operator()<protobuf_varint_type::sint32>(mixed_length_values<int32_t>(1000), zigzag);
+        verify.operator()<protobuf_varint_type::sint64>(mixed_length_values<int64_t>(1000), zigzag);
+        verify.operator()<protobuf_varint_type::enumeration>(std::vector<int32_t>{0, 1, -1, 300, -300, 5}, raw);
+        verify.operator()<protobuf_varint_type::boolean>(std::vector<uint8_t>{1, 0, 1, 1}, raw);
+    };
+
+    "errors"_test = []
+    {
+        // a bool encoded with more than one byte is still true
+        const char overlong_bool[] = {3, char(0x80), 0x01, 0x00};
+        std::vector<uint8_t> bools;
+        auto r = parse_packed_field<protobuf_varint_type::boolean>(overlong_bool, std::end(overlong_bool), bools);
+        expect(r.ec == std::errc{});
+        expect(bools == std::vector<uint8_t>{1, 0});
+
+        // a length past the end of the buffer
+        const char truncated_field[] = {5, 1, 2};
+        std::vector<uint64_t> values;
+        r = parse_packed_field<protobuf_varint_type::uint64>(truncated_field, std::end(truncated_field), values);
+        expect(r.ec == std::errc::invalid_argument);
+        expect(r.ptr == truncated_field);
+
+        // a payload ending inside a varint
+        const char truncated_varint[] = {3, 1, 2, char(0x80)};
+        r = parse_packed_field<protobuf_varint_type::uint64>(truncated_varint, std::end(truncated_varint), values);
+        expect(r.ec == std::errc::invalid_argument);
+        expect(r.ptr == truncated_varint + 3);
+        expect(values == std::vector<uint64_t>{1, 2});
+
+        // a value too large for uint32
+        std::vector<uint32_t> values32;
+        auto field = std::vector<char>{6, 1, char(0x80), char(0x80), char(0x80), char(0x80), 0x10};
+        r = parse_packed_field<protobuf_varint_type::uint32>(field.data(), field.data() + field.size(), values32);
+        expect(r.ec == std::errc::result_out_of_range);
+        expect(values32 == std::vector<uint32_t>{1});
+
+        protobuf_tag tag;
+        const char zero_tag[] = {0};
+        expect(parse_protobuf_tag(zero_tag, std::end(zero_tag), tag).ec == std::errc::result_out_of_range);
+        const char bad_wire_type[] = {0x0e};
+        expect(parse_protobuf_tag(bad_wire_type, std::end(bad_wire_type), tag).ec == std::errc::result_out_of_range);
+    };
+};
+
+suite protobuf_scanner_test = []
+{
+    // a message of fields of every wire type; the reference index is built
+    // a field at a time with parse_protobuf_tag and parse_checked_varint
+    std::vector<char> message(20000);
+    std::span<char> out{message};
+    auto tag = [&](uint32_t field_number, protobuf_wire_type type)
+    { pack_varint(uint64_t(field_number) << 3 | uint64_t(type), out); };
+    std::vector<protobuf_field> expected;
+    auto offset = [&] { return message.size() - out.size(); };
+    const auto values = mixed_length_values<uint64_t>(300);
+    for (std::size_t i = 0; i < values.size(); ++i)
+    {
+        const uint32_t field_number = i % 7 == 0 ? 100000 + i : i + 1;
+        switch (i % 5)
+        {
+        case 0:
+        case 1:
+            tag(field_number, protobuf_wire_type::varint);
+            expected.push_back({field_number, protobuf_wire_type::varint, offset(), pack_varint(values[i], out)});
+            break;
+        case 2:
+        {
+            tag(field_number, protobuf_wire_type::len);
+            const std::size_t length = values[i] % 200;
+            pack_varint(uint64_t(length), out);
+            expected.push_back({field_number, protobuf_wire_type::len, offset(), length});
+            // payload bytes that look like unterminated varints
+            std::fill_n(out.begin(), length, char(0x80));
+            out = out.subspan(length);
+            break;
+        }
+        case 3:
+            tag(field_number, protobuf_wire_type::i64);
+            expected.push_back({field_number, protobuf_wire_type::i64, offset(), 8});
+            std::fill_n(out.begin(), 8, char(0xff));
+            out = out.subspan(8);
+            break;
+        case 4:
+        {
+            // a group holding a varint field and a nested group
+            tag(field_number, protobuf_wire_type::sgroup);
+            const std::size_t begin = offset();
+            tag(1, protobuf_wire_type::varint);
+            pack_varint(values[i], out);
+            tag(2, protobuf_wire_type::sgroup);
+            tag(2, protobuf_wire_type::egroup);
+            expected.push_back({field_number, protobuf_wire_type::sgroup, begin, offset() - begin});
+            tag(field_number, protobuf_wire_type::egroup);
+            tag(field_number, protobuf_wire_type::i32);
+            expected.push_back({field_number, protobuf_wire_type::i32, offset(), 4});
+            std::fill_n(out.begin(), 4, char(0xff));
+            out = out.subspan(4);
+            break;
+        }
+        }
+    }
+    message.resize(offset());
+
+    "index"_test = [&]
+    {
+        std::vector<protobuf_field> index;
+        auto r = scan_protobuf_fields(message, index);
+        expect(r.ec == std::errc{});
+        expect(r.ptr == message.data() + message.size());
+        expect(index.size() == expected.size());
+        for (std::size_t i = 0; i < std::min(index.size(), expected.size()); ++i)
+        {
+            expect(index[i].field_number == expected[i].field_number);
+            expect(index[i].wire_type == expected[i].wire_type);
+            expect(index[i].offset == expected[i].offset);
+            expect(index[i].length == expected[i].length);
+        }
+
+        // a group and the i32 field after it share their number
+        for (const auto &field : {expected[3], expected[150], expected[expected.size() - 2]})
+        {
+            const auto found = find_protobuf_field(message, field.field_number);
+            expect(found.offset == field.offset && found.length == field.length);
+        }
+        expect(find_protobuf_field(message, 99).field_number == 0);
+    };
+
+    "errors"_test = [&]
+    {
+        std::vector<protobuf_field> index;
+
+        // the message ending inside a varint value, and inside a len field
+        const char truncated_varint[] = {0x08, 0x01, 0x10, char(0x80)};
+        auto r = scan_protobuf_fields(truncated_varint, index);
+        expect(r.ec == std::errc::invalid_argument);
+        expect(r.ptr == truncated_varint + 2);
+        expect(index.size() == 1);
+        const char truncated_len[] = {0x0a, 0x05, 0x01};
+        expect(scan_protobuf_fields(truncated_len, index).ec == std::errc::invalid_argument);
+        const char truncated_i64[] = {0x09, 0x01};
+        expect(scan_protobuf_fields(truncated_i64, index).ec == std::errc::invalid_argument);
+
+        // an 11-byte varint value
+        std::vector<char> too_long{0x08};
+        too_long.insert(too_long.end(), 10, char(0x80));
+        too_long.push_back(0x01);
+        r = scan_protobuf_fields(too_long, index);
+        expect(r.ec == std::errc::value_too_large);
+        expect(r.ptr == too_long.data());
+
+        const char bad_tag[] = {0x08, 0x01, 0x0f, 0x01};
+        r = scan_protobuf_fields(bad_tag, index);
+        expect(r.ec == std::errc::result_out_of_range);
+        expect(r.ptr == bad_tag + 2);
+
+        // an egroup closing a different group, or none
+        const char mismatched_group[] = {0x0b, 0x14};
+        expect(scan_protobuf_fields(mismatched_group, index).ec == std::errc::bad_message);
+        const char unopened_group[] = {0x0c};
+        expect(scan_protobuf_fields(unopened_group, index).ec == std::errc::bad_message);
+        const char unclosed_group[] = {0x0b, 0x10, 0x01};
+        r = scan_protobuf_fields(unclosed_group, index);
+        expect(r.ec == std::errc::invalid_argument);
+        expect(r.ptr == unclosed_group);
+    };
+};
+
+suite records_test = []
+{
+    // records of every length prefix size up to 3 bytes, the last ones
+    // framed with the checked parser
+    std::vector<std::string> expected;
+    std::vector<char> buffer(400000);
+    std::span<char> out{buffer};
+    for (std::size_t i = 0; i < 500; ++i)
+    {
+        const std::size_t length = i % 50 == 0 ? 17000 + i : (i * 37) % 300;
+        expected.push_back(std::string(length, char('a' + i % 26)));
+        pack_varint(uint64_t(length), out);
+        std::copy(expected.back().begin(), expected.back().end(), out.begin());
+        out = out.subspan(length);
+    }
+    buffer.resize(buffer.size() - out.size());
+
+    "records"_test = [&]
+    {
+        std::vector<std::string_view> views{"appended to"};
+        auto r = parse_varint_records(buffer, views);
+        expect(r.ec == std::errc{});
+        expect(r.ptr == buffer.data() + buffer.size());
+        expect(std::equal(views.begin() + 1, views.end(), expected.begin(), expected.end()));
+
+        std::vector<std::span<const char>> spans;
+        r = parse_varint_records(buffer, spans);
+        expect(r.ec == std::errc{});
+        expect(spans.size() == expected.size());
+        expect(spans.back().data() + spans.back().size() == buffer.data() + buffer.size());
+
+        std::vector<std::string_view> empty;
+        expect(parse_varint_records(std::span<const char>{}, empty).ec == std::errc{});
+        expect(empty.empty());
+    };
+
+    "errors"_test = [&]
+    {
+        // the buffer ending inside the last record, or inside its prefix
+        std::vector<std::string_view> views;
+        const auto *last = buffer.data() + buffer.size() - expected.back().size() - 2;
+        auto r = parse_varint_records({buffer.data(), buffer.size() - 1}, views);
+        expect(r.ec == std::errc::invalid_argument);
+        expect(r.ptr == last);
+        expect(views.size() == expected.size() - 1);
+        const char truncated_prefix[] = {1, 'a', char(0x80)};
+        views.clear();
+        r = parse_varint_records(truncated_prefix, views);
+        expect(r.ec == std::errc::invalid_argument);
+        expect(r.ptr == truncated_prefix + 2);
+        expect(views == std::vector<std::string_view>{"a"});
+
+        // a length beyond the buffer, close to the end and far from it
+        const char huge_length[] = {char(0xff), char(0xff), char(0xff), char(0xff), char(0xff),
+                                    char(0xff), char(0xff), char(0xff), char(0xff), 0x7f};
+        expect(parse_varint_records(huge_length, views).ec == std::errc::invalid_argument);
+        std::vector<char> far(huge_length, std::end(huge_length));
+        far.resize(100);
+        expect(parse_varint_records(far, views).ec == std::errc::invalid_argument);
+
+        // an 11-byte length prefix
+        std::vector<char> too_long(10, char(0x80));
+        too_long.resize(100, 0x01);
+        r = parse_varint_records(too_long, views);
+        expect(r.ec == std::errc::value_too_large);
+        expect(r.ptr == too_long.data());
+    };
+};
+
 int main() {}
\ No newline at end of file
@@ -0,0 +1,134 @@
+#pragma once
+#include "checked_varint_parser.h"
+#include "varint_parser.h"
+
+#include <cstdint>
+#include <cstring>
+#include <immintrin.h>
+#include <type_traits>
+
+// Bulk decoder for 32-bit fields, writing packed uint32_t / int32_t output.
+//
+// Varints are decoded from 8-byte words and capped at 5 bytes, so values are
+// never built in 64 bits. The sign-extended 10-byte encoding of negative int32
+// values gets a fast path of its own. Anything else that doesn't fit in T is
+// reported like checked_varint_parser does rather than truncated: the slow
+// path defers to parse_checked_varint(), which also settles overlong and
+// truncated encodings. With AVX2 the leading varints of up to 4 bytes are
+// decoded with the Masked VByte shuffles, which can't overflow.
+template <typename T>
+struct varint32_parser {
+  static_assert(sizeof(T) == 4 && std::is_integral_v<T>);
+
+  // bytes 0-3 continue, byte 4 holds bits 28-34 with bits 31-34 set and bytes
+  // 5-7 hold all ones; bytes 8 and 9 are checked separately
+  static constexpr uint64_t negative_bits = 0xfffffff880808080ULL;
+
+  // value of the varint in the first width <= 5 bytes of word, bits 32-34
+  // included
+  static inline uint64_t extract(uint64_t word, int width) {
+    word &= (1ULL << (CHAR_BIT * width)) - 1;
+#ifdef __BMI2__
+    return _pext_u64(word, 0x7f7f7f7f7fULL);
+#else
+    return (word & 0x7f) | ((word >> 1) & (0x7fULL << 7)) | ((word >> 2) & (0x7fULL << 14)) |
+           ((word >> 3) & (0x7fULL << 21)) | ((word >> 4) & (0x7fULL << 28));
+#endif
+  }
+
+  static inline bool widen_bytes(const char *p, T *result) {
+#ifdef __AVX2__
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    if (_mm_movemask_epi8(v) != 0)
+      return false;
+    auto out = reinterpret_cast<__m256i *>(result);
+    _mm256_storeu_si256(out, _mm256_cvtepu8_epi32(v));
+    _mm256_storeu_si256(out + 1, _mm256_cvtepu8_epi32(_mm_srli_si128(v, 8)));
+    return true;
+#else
+    uint64_t words[2];
+    memcpy(words, p, sizeof(words));
+    if (((words[0] | words[1]) & 0x8080808080808080ULL) != 0)
+      return false;
+    for (int i = 0; i < 16; ++i)
+      result[i] = static_cast<T>(uint8_t(p[i]));
+    return true;
+#endif
+  }
+
+  // decodes the varint at begin, reading up to 10 bytes when they're there
+  static inline varint_parse_result parse_one(const char *begin, const char *end, T *result) {
+    if (end - begin >= 10) [[likely]] {
+      uint64_t word;
+      memcpy(&word, begin, sizeof(word));
+      const uint64_t stops = ~word & 0x8080808080808080ULL;
+      const int width = stops == 0 ? 9 : std::countr_zero(stops) / CHAR_BIT + 1;
+      if (width < 5 || (width == 5 && uint8_t(begin[4]) <= 0x0f)) [[likely]] {
+        *result = static_cast<T>(extract(word, width));
+        return {begin + width, {}};
+      }
+      if constexpr (std::is_signed_v<T>) {
+        uint16_t last;
+        memcpy(&last, begin + 8, sizeof(last));
+        if ((word & negative_bits) == negative_bits && last == 0x01ff) {
+          *result = static_cast<T>(extract(word, 5));
+          return {begin + 10, {}};
+        }
+      }
+    }
+    return parse_checked_varint(begin, end, *result);
+  }
+
+  static varint_parse_result parse(const char *begin, const char *end, T *result) {
+#ifdef __AVX2__
+    // The Masked VByte tables, skipping the overflow checks for entries that
+    // only hold varints of up to 4 bytes.
+    using vector_parser = masked_vbyte_parser<32>;
+    const auto &table = masked_vbyte_table::get();
+    raw_varint_output raw;
+    while (end - begin >= 32) {
+      const uint32_t mask = vector_parser::continuation_mask(begin);
+      if (mask == 0) {
+        for (int i = 0; i < 32; i += 16)
+          vector_parser::output_bytes(_mm_loadu_si128(reinterpret_cast<const __m128i *>(begin + i)), result,
+                                      raw);
+        begin += 32;
+        continue;
+      }
+      const auto &e = table.entries[mask & 0xfff];
+      if (e.kind == 1 || e.kind == 2) [[likely]] {
+        vector_parser::output_entry(table, e, mask, begin, result, raw);
+        begin += e.consumed;
+        continue;
+      }
+      auto r = parse_one(begin, end, result);
+      if (r.ec != std::errc{}) [[unlikely]]
+        return r;
+      ++result;
+      begin = r.ptr;
+    }
+#endif
+
+    while (end - begin >= 16) {
+      if ((*begin & 0x80) == 0 && widen_bytes(begin, result)) {
+        begin += 16;
+        result += 16;
+        continue;
+      }
+      auto r = parse_one(begin, end, result);
+      if (r.ec != std::errc{}) [[unlikely]]
+        return r;
+      ++result;
+      begin = r.ptr;
+    }
+
+    while (begin < end) {
+      auto r = parse_checked_varint(begin, end, *result);
+      if (r.ec != std::errc{})
+        return r;
+      ++result;
+      begin = r.ptr;
+    }
+    return {begin, {}};
+  }
+};
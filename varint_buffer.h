@@ -0,0 +1,121 @@
+#pragma once
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include <span>
+#include <utility>
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+// Byte buffer followed by at least Padding zeroed bytes, so the bulk decoders
+// can load whole words or vectors past the last varint and skip their scalar
+// tail loops; see the varint_buffer overloads in varint_parser.h. With
+// huge_pages the storage is mmap'ed and advised for transparent huge pages.
+template <std::size_t Padding = 64, std::size_t Alignment = 64>
+class varint_buffer {
+  static_assert(std::has_single_bit(Alignment));
+
+  char *data_ = nullptr;
+  std::size_t size_ = 0;
+  std::size_t capacity_ = 0;
+  bool huge_pages_ = false;
+
+  static constexpr std::size_t huge_page_size = 2 << 20;
+
+  static char *allocate(std::size_t capacity, bool huge_pages) {
+#ifdef __linux__
+    if (huge_pages) {
+      static_assert(Alignment <= 4096, "mmap only guarantees page alignment");
+      void *p = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (p == MAP_FAILED)
+        throw std::bad_alloc();
+      madvise(p, capacity, MADV_HUGEPAGE);
+      return static_cast<char *>(p);
+    }
+#endif
+    return static_cast<char *>(::operator new(capacity, std::align_val_t(Alignment)));
+  }
+
+  void deallocate() {
+    if (data_ == nullptr)
+      return;
+#ifdef __linux__
+    if (huge_pages_) {
+      munmap(data_, capacity_);
+      return;
+    }
+#endif
+    ::operator delete(data_, std::align_val_t(Alignment));
+  }
+
+  std::size_t capacity_for(std::size_t size) const {
+    auto capacity = size + Padding;
+    if (huge_pages_)
+      capacity = (capacity + huge_page_size - 1) / huge_page_size * huge_page_size;
+    return capacity;
+  }
+
+public:
+  static constexpr std::size_t padding = Padding;
+  static constexpr std::size_t alignment = Alignment;
+
+  varint_buffer() = default;
+
+  explicit varint_buffer(std::size_t size, bool huge_pages = false) : huge_pages_(huge_pages) {
+    resize(size);
+  }
+
+  explicit varint_buffer(std::span<const char> content, bool huge_pages = false)
+      : varint_buffer(content.size(), huge_pages) {
+    std::copy(content.begin(), content.end(), data_);
+  }
+
+  varint_buffer(varint_buffer &&other) noexcept
+      : data_(std::exchange(other.data_, nullptr)), size_(std::exchange(other.size_, 0)),
+        capacity_(std::exchange(other.capacity_, 0)), huge_pages_(other.huge_pages_) {}
+
+  varint_buffer &operator=(varint_buffer &&other) noexcept {
+    if (this != &other) {
+      deallocate();
+      data_ = std::exchange(other.data_, nullptr);
+      size_ = std::exchange(other.size_, 0);
+      capacity_ = std::exchange(other.capacity_, 0);
+      huge_pages_ = other.huge_pages_;
+    }
+    return *this;
+  }
+
+  ~varint_buffer() { deallocate(); }
+
+  char *data() { return data_; }
+  const char *data() const { return data_; }
+  std::size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  char *begin() { return data_; }
+  char *end() { return data_ + size_; }
+  const char *begin() const { return data_; }
+  const char *end() const { return data_ + size_; }
+
+  operator std::span<const char>() const { return {data_, size_}; }
+
+  // New bytes are zeroed, as is the padding after them.
+  void resize(std::size_t size) {
+    if (size + Padding > capacity_) {
+      auto capacity = capacity_for(std::max(size, size_ * 2));
+      auto data = allocate(capacity, huge_pages_);
+      if (size_ > 0)
+        memcpy(data, data_, size_);
+      deallocate();
+      data_ = data;
+      capacity_ = capacity;
+    }
+    if (size > size_)
+      memset(data_ + size_, 0, size - size_ + Padding);
+    else
+      memset(data_ + size, 0, Padding);
+    size_ = size;
+  }
+};
@@ -0,0 +1,131 @@
+// Decodes a file of LEB128 varints, as offline jobs read them, and reports the
+// throughput including the page faults of the mapping and the
+// varints_fit_64_bits() check of every block, which also counts its varints:
+//
+//   varint_decode [options] FILE
+//
+//   --decoder NAME    kernel of varint_dispatch, default the best for the CPU
+//   --populate        map with MAP_POPULATE, faulting the file in up front
+//   --no-huge-pages   don't advise MADV_HUGEPAGE
+//   --block-size N    bytes decoded per block, default 65536
+//   --repeat N        decode N times and report the fastest
+//   --list            list the kernels the CPU supports
+#include "varint_dispatch.h"
+#include "varint_file.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string_view>
+#include <system_error>
+
+namespace {
+
+void usage(const char *program) {
+  std::fprintf(stderr,
+               "usage: %s [--decoder NAME] [--populate] [--no-huge-pages] [--block-size N] [--repeat N] "
+               "[--list] FILE\n",
+               program);
+  std::exit(2);
+}
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  const varint_decoder *decoder = &selected_varint_decoder();
+  mapped_file_options options;
+  std::size_t block_bytes = 64 << 10;
+  int repeat = 1;
+  const char *path = nullptr;
+
+  for (int i = 1; i < argc; ++i) {
+    const std::string_view arg = argv[i];
+    const auto value = [&] {
+      if (i + 1 == argc)
+        usage(argv[0]);
+      return argv[++i];
+    };
+    if (arg == "--decoder") {
+      const std::string_view name = value();
+      decoder = nullptr;
+      for (const auto &d : supported_varint_decoders())
+        if (d.name == name)
+          decoder = &d;
+      if (decoder == nullptr) {
+        std::fprintf(stderr, "unknown or unsupported decoder %.*s, see --list\n", int(name.size()), name.data());
+        return 2;
+      }
+    } else if (arg == "--populate") {
+      options.populate = true;
+    } else if (arg == "--no-huge-pages") {
+      options.huge_pages = false;
+    } else if (arg == "--block-size") {
+      block_bytes = std::strtoull(value(), nullptr, 0);
+      if (block_bytes == 0)
+        usage(argv[0]);
+    } else if (arg == "--repeat") {
+      repeat = std::atoi(value());
+      if (repeat < 1)
+        usage(argv[0]);
+    } else if (arg == "--list") {
+      for (const auto &d : supported_varint_decoders())
+        std::printf("%.*s\n", int(d.name.size()), d.name.data());
+      return 0;
+    } else if (arg.starts_with("-") || path != nullptr) {
+      usage(argv[0]);
+    } else {
+      path = argv[i];
+    }
+  }
+  if (path == nullptr)
+    usage(argv[0]);
+
+  try {
+    auto start = std::chrono::steady_clock::now();
+    const mapped_varint_file file(path, options);
+    const double map_seconds = seconds_since(start);
+
+    double best = 0;
+    std::size_t count = 0;
+    uint64_t checksum = 0;
+    const char *stop = nullptr;
+    for (int r = 0; r < repeat; ++r) {
+      count = 0;
+      checksum = 0;
+      start = std::chrono::steady_clock::now();
+      stop = decode_varint_blocks(
+          file, decoder->parse,
+          [&](std::span<const uint64_t> values) {
+            count += values.size();
+            for (auto v : values)
+              checksum += v;
+          },
+          block_bytes);
+      const double seconds = seconds_since(start);
+      if (r == 0 || seconds < best)
+        best = seconds;
+    }
+
+    std::printf("decoder    %.*s\n", int(decoder->name.size()), decoder->name.data());
+    std::printf("bytes      %zu\n", file.size());
+    std::printf("varints    %zu\n", count);
+    std::printf("checksum   %016llx\n", static_cast<unsigned long long>(checksum));
+    std::printf("map        %.3f ms\n", map_seconds * 1e3);
+    std::printf("decode     %.3f ms, %.2f GB/s, %.2f Gvarints/s\n", best * 1e3,
+                best > 0 ? file.size() / best * 1e-9 : 0.0, best > 0 ? count / best * 1e-9 : 0.0);
+    if (stop != file.data() + file.size()) {
+      std::fprintf(stderr, "%s: malformed varint at offset %zu\n", path, std::size_t(stop - file.data()));
+      return 1;
+    }
+  } catch (const std::system_error &e) {
+    std::fprintf(stderr, "%s\n", e.what());
+    return 1;
+  }
+  return 0;
+}
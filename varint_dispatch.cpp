@@ -0,0 +1,136 @@
+#include "varint_dispatch.h"
+
+#include <cpuid.h>
+#include <cstdlib>
+#include <vector>
+
+namespace varint_generic {
+const char *parse_shift_mix(const char *begin, const char *end, uint64_t *result);
+const char *parse_ubfx(const char *begin, const char *end, uint64_t *result);
+std::size_t count_varints(std::span<const char> range);
+} // namespace varint_generic
+
+namespace varint_bmi2 {
+const char *parse_bmi(const char *begin, const char *end, uint64_t *result);
+const char *parse_ubfx(const char *begin, const char *end, uint64_t *result);
+std::size_t count_varints(std::span<const char> range);
+} // namespace varint_bmi2
+
+namespace varint_avx2 {
+const char *parse_masked_vbyte(const char *begin, const char *end, uint64_t *result);
+std::size_t count_varints(std::span<const char> range);
+} // namespace varint_avx2
+
+namespace varint_avx512 {
+const char *parse_masked_vbyte512(const char *begin, const char *end, uint64_t *result);
+std::size_t count_varints(std::span<const char> range);
+} // namespace varint_avx512
+
+namespace {
+
+struct cpu_features {
+  // the kernels built for bmi2 and up may also use popcnt, tzcnt (BMI1) and
+  // lzcnt, see VARINT_KERNEL_FLAGS_bmi2
+  bool bmi2;
+  // pdep/pext are microcoded on AMD before Zen 3 and far slower than the
+  // portable code paths there
+  bool fast_pdep;
+  bool avx2;
+  bool avx512;
+
+  cpu_features() {
+    __builtin_cpu_init();
+    unsigned eax, ebx, ecx, edx;
+    // LZCNT, named ABM on AMD
+    const bool lzcnt = __get_cpuid(0x80000001, &eax, &ebx, &ecx, &edx) && (ecx & bit_LZCNT) != 0;
+    bmi2 = __builtin_cpu_supports("bmi2") && __builtin_cpu_supports("bmi") && __builtin_cpu_supports("popcnt") &&
+           lzcnt;
+    avx2 = __builtin_cpu_supports("avx2") && bmi2;
+    avx512 = __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512vl") &&
+             __builtin_cpu_supports("avx512vbmi2") && avx2;
+
+    bool amd = false;
+    if (__get_cpuid(0, &eax, &ebx, &ecx, &edx))
+      amd = ebx == 0x68747541 && edx == 0x69746e65 && ecx == 0x444d4163; // "AuthenticAMD"
+    unsigned family = 0;
+    if (__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+      family = (eax >> 8) & 0xf;
+      if (family == 0xf)
+        family += (eax >> 20) & 0xff;
+    }
+    fast_pdep = bmi2 && !(amd && family < 0x19);
+  }
+};
+
+template <typename Kernel>
+struct candidate {
+  Kernel kernel;
+  bool cpu_features::*requires_feature;
+};
+
+const cpu_features &cpu() {
+  static const cpu_features features;
+  return features;
+}
+
+constexpr bool cpu_features::*always = nullptr;
+
+template <typename Kernel, std::size_t N>
+std::vector<Kernel> filter_supported(const candidate<Kernel> (&candidates)[N]) {
+  std::vector<Kernel> result;
+  for (const auto &c : candidates) {
+    if (c.requires_feature == always || cpu().*c.requires_feature)
+      result.push_back(c.kernel);
+  }
+  return result;
+}
+
+// best first
+constexpr candidate<varint_decoder> decoders[] = {
+    {{"bmi", varint_bmi2::parse_bmi}, &cpu_features::fast_pdep},
+    {{"masked_vbyte512", varint_avx512::parse_masked_vbyte512}, &cpu_features::avx512},
+    {{"masked_vbyte", varint_avx2::parse_masked_vbyte}, &cpu_features::avx2},
+    {{"ubfx_pext", varint_bmi2::parse_ubfx}, &cpu_features::fast_pdep},
+    {{"shift_mix", varint_generic::parse_shift_mix}, always},
+    {{"ubfx", varint_generic::parse_ubfx}, always},
+};
+
+constexpr candidate<varint_counter> counters[] = {
+    {{"avx512", varint_avx512::count_varints}, &cpu_features::avx512},
+    {{"avx2", varint_avx2::count_varints}, &cpu_features::avx2},
+    {{"popcnt", varint_bmi2::count_varints}, &cpu_features::bmi2},
+    {{"generic", varint_generic::count_varints}, always},
+};
+
+template <typename Kernel>
+const Kernel &select(std::span<const Kernel> supported, const char *env) {
+  if (const char *name = std::getenv(env)) {
+    for (const auto &k : supported) {
+      if (k.name == name)
+        return k;
+    }
+  }
+  return supported.front();
+}
+
+} // namespace
+
+std::span<const varint_decoder> supported_varint_decoders() {
+  static const auto result = filter_supported(decoders);
+  return result;
+}
+
+std::span<const varint_counter> supported_varint_counters() {
+  static const auto result = filter_supported(counters);
+  return result;
+}
+
+const varint_decoder &selected_varint_decoder() {
+  static const auto &result = select(supported_varint_decoders(), "VARINT_DECODER");
+  return result;
+}
+
+const varint_counter &selected_varint_counter() {
+  static const auto &result = select(supported_varint_counters(), "VARINT_COUNTER");
+  return result;
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <cstdint>
+#include <span>
+#include <string_view>
+
+// Runtime selection of the bulk decoding and counting kernels.
+//
+// The kernels are compiled once per instruction set level (see
+// varint_kernels.cpp) and the best one for the running CPU is chosen on first
+// use, so a single build without -march=native runs everywhere. The choice can
+// be overridden with the VARINT_DECODER / VARINT_COUNTER environment variables
+// set to a kernel name.
+
+using varint_parse_fn = const char *(*)(const char *begin, const char *end, uint64_t *result);
+using varint_count_fn = std::size_t (*)(std::span<const char> range);
+
+struct varint_decoder {
+  std::string_view name;
+  varint_parse_fn parse;
+};
+
+struct varint_counter {
+  std::string_view name;
+  varint_count_fn count;
+};
+
+// Kernels usable on the running CPU, best first.
+std::span<const varint_decoder> supported_varint_decoders();
+std::span<const varint_counter> supported_varint_counters();
+
+const varint_decoder &selected_varint_decoder();
+const varint_counter &selected_varint_counter();
+
+// Same contract as the bulk parsers in varint_parser.h.
+inline const char *dispatch_parse_varints(const char *begin, const char *end, uint64_t *result) {
+  static const auto parse = selected_varint_decoder().parse;
+  return parse(begin, end, result);
+}
+
+// Number of varint terminators in range.
+inline std::size_t dispatch_count_varints(std::span<const char> range) {
+  static const auto count = selected_varint_counter().count;
+  return count(range);
+}
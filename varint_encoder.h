@@ -0,0 +1,403 @@
+#pragma once
+#include "parse_varint.h"
+
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <immintrin.h>
+#include <span>
+#include <type_traits>
+
+// Number of bytes needed to encode v: 1 + floor(log2(v)) / 7, with the
+// division done as a multiplication by 9/64, which is exact for 0 to 63.
+inline constexpr int varint_size(uint64_t v) {
+  return ((63 - std::countl_zero(v | 1)) * 9 + 73) / 64;
+}
+
+// Spreads the low 56 bits of v into the low 7 bits of each byte.
+inline constexpr uint64_t spread_varint_bits(uint64_t v) {
+  if (!std::is_constant_evaluated()) {
+#ifdef __BMI2__
+    return _pdep_u64(v, 0x7f7f7f7f7f7f7f7fULL);
+#endif
+  }
+  uint64_t result = 0;
+  for (int i = 0; i < 8; ++i)
+    result |= ((v >> (7 * i)) & 0x7fULL) << (CHAR_BIT * i);
+  return result;
+}
+
+// All the bulk encoders below write at most
+// `in.size() * varint_max_size<T>` bytes starting at `out` and may store past
+// the end of the encoded data within that bound; they return the end of the
+// encoded data. Signed values are encoded like pack_varint() does, i.e. as
+// their unsigned counterpart of the same width, unless an Input stage says
+// otherwise.
+template <typename T>
+constexpr auto encoded_value(T v) {
+  return static_cast<uint64_t>(static_cast<std::make_unsigned_t<T>>(v));
+}
+
+// Input stages of the bulk encoders, the counterparts of the decoders' output
+// stages: every value goes through one before it is encoded. lanes<T>() does
+// the same for vectors of values of type T zero-extended to 64-bit lanes.
+struct raw_varint_input {
+  template <typename T>
+  uint64_t operator()(T v) { return encoded_value(v); }
+#ifdef __AVX2__
+  template <typename T, typename V>
+  V lanes(V v) { return v; }
+#endif
+};
+
+// For protobuf sint32/sint64 fields, see zigzag_encode().
+struct zigzag_varint_input {
+  template <typename T>
+  uint64_t operator()(T v) { return zigzag_encode(v); }
+#ifdef __AVX2__
+  // zigzag on the low sizeof(T) bytes: (v << 1) ^ -sign
+  template <typename T>
+  __m256i lanes(__m256i v) {
+    constexpr int bits = sizeof(T) * CHAR_BIT;
+    const __m256i sign = _mm256_sub_epi64(
+        _mm256_setzero_si256(), _mm256_and_si256(_mm256_srli_epi64(v, bits - 1), _mm256_set1_epi64x(1)));
+    const __m256i r = _mm256_xor_si256(_mm256_slli_epi64(v, 1), sign);
+    if constexpr (bits == 64)
+      return r;
+    else
+      return _mm256_and_si256(r, _mm256_set1_epi64x((1LL << bits) - 1));
+  }
+#endif
+#ifdef __AVX512F__
+  template <typename T>
+  __m512i lanes(__m512i v) {
+    constexpr int bits = sizeof(T) * CHAR_BIT;
+    const __m512i r = _mm512_xor_si512(_mm512_slli_epi64(v, 1),
+                                       _mm512_srai_epi64(_mm512_slli_epi64(v, 64 - bits), 63));
+    if constexpr (bits == 64)
+      return r;
+    else
+      return _mm512_and_si512(r, _mm512_set1_epi64((1LL << bits) - 1));
+  }
+#endif
+};
+
+// Encodes the difference of each value to the previous one, starting from
+// base, through the Inner stage; see delta_varint_output.
+template <typename Inner = raw_varint_input>
+struct delta_varint_input {
+  uint64_t base = 0;
+  [[no_unique_address]] Inner inner;
+
+  template <typename T>
+  uint64_t operator()(T v) {
+    using U = std::make_unsigned_t<T>;
+    const auto delta = static_cast<T>(static_cast<U>(static_cast<U>(v) - static_cast<U>(base)));
+    base = static_cast<U>(v);
+    return inner(delta);
+  }
+
+#ifdef __AVX2__
+  template <typename T>
+  __m256i lanes(__m256i v) {
+    const __m256i prev = _mm256_blend_epi32(_mm256_permute4x64_epi64(v, _MM_SHUFFLE(2, 1, 0, 0)),
+                                            _mm256_set1_epi64x(base), 0x03);
+    base = _mm256_extract_epi64(v, 3);
+    __m256i delta = _mm256_sub_epi64(v, prev);
+    if constexpr (sizeof(T) < 8)
+      delta = _mm256_and_si256(delta, _mm256_set1_epi64x((1LL << (sizeof(T) * CHAR_BIT)) - 1));
+    return inner.template lanes<T>(delta);
+  }
+#endif
+#ifdef __AVX512F__
+  template <typename T>
+  __m512i lanes(__m512i v) {
+    const __m512i prev = _mm512_alignr_epi64(v, _mm512_set1_epi64(base), 7);
+    base = _mm256_extract_epi64(_mm512_extracti64x4_epi64(v, 1), 3);
+    __m512i delta = _mm512_sub_epi64(v, prev);
+    if constexpr (sizeof(T) < 8)
+      delta = _mm512_and_si512(delta, _mm512_set1_epi64((1LL << (sizeof(T) * CHAR_BIT)) - 1));
+    return inner.template lanes<T>(delta);
+  }
+#endif
+};
+
+#ifdef __AVX2__
+// 4 values of type T zero-extended to 64-bit lanes
+template <typename T>
+inline __m256i load_varint_lanes256(const T *p) {
+  if constexpr (sizeof(T) == 8)
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+  else if constexpr (sizeof(T) == 4)
+    return _mm256_cvtepu32_epi64(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)));
+  else if constexpr (sizeof(T) == 2)
+    return _mm256_cvtepu16_epi64(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(p)));
+  else {
+    int32_t bytes;
+    memcpy(&bytes, p, sizeof(bytes));
+    return _mm256_cvtepu8_epi64(_mm_cvtsi32_si128(bytes));
+  }
+}
+#endif
+
+#ifdef __AVX512F__
+// 8 values of type T zero-extended to 64-bit lanes
+template <typename T>
+inline __m512i load_varint_lanes512(const T *p) {
+  if constexpr (sizeof(T) == 8)
+    return _mm512_loadu_si512(p);
+  else if constexpr (sizeof(T) == 4)
+    return _mm512_cvtepu32_epi64(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(p)));
+  else if constexpr (sizeof(T) == 2)
+    return _mm512_cvtepu16_epi64(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)));
+  else
+    return _mm512_cvtepu8_epi64(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(p)));
+}
+#endif
+
+struct pdep_varint_encoder {
+  template <bool Exact>
+  static inline char *encode_one(uint64_t v, char *out) {
+    uint64_t word = spread_varint_bits(v);
+    if (v < (1ULL << 56)) [[likely]] {
+      const int n = varint_size(v);
+      word |= 0x0080808080808080ULL >> (CHAR_BIT * (8 - n));
+      memcpy(out, &word, Exact ? n : sizeof(word));
+      return out + n;
+    }
+    word |= 0x8080808080808080ULL;
+    memcpy(out, &word, sizeof(word));
+    auto high = v >> 56;
+    out[8] = char(high | (high >= 0x80 ? 0x80 : 0));
+    if (high < 0x80)
+      return out + 9;
+    out[9] = 1;
+    return out + 10;
+  }
+
+  // values near the end of the output are stored byte-exact when there may not
+  // be 8 bytes of room left
+  template <typename T>
+  static constexpr std::size_t exact_tail = (8 + varint_max_size<T> - 1) / varint_max_size<T> - 1;
+
+  template <typename Input = raw_varint_input, typename T>
+  static char *encode(std::span<const T> in, char *out, Input stage = {}) {
+    auto tail = in.size() < exact_tail<T> ? in.size() : exact_tail<T>;
+    for (auto v : in.first(in.size() - tail))
+      out = encode_one<false>(stage(v), out);
+    for (auto v : in.last(tail))
+      out = encode_one<true>(stage(v), out);
+    return out;
+  }
+};
+
+#ifdef __AVX2__
+// Spreads the bits of 4 values below 2^56 at a time and stores each lane with
+// an 8-byte store; there's no pdep on the critical path, which matters on CPUs
+// where pdep is microcoded.
+struct avx2_varint_encoder {
+  template <typename Input = raw_varint_input, typename T>
+  static char *encode(std::span<const T> in, char *out, Input stage = {}) {
+    constexpr std::size_t lanes = 4;
+    std::size_t i = 0;
+    for (; in.size() - i >= lanes && (in.size() - i) * varint_max_size<T> >= lanes * 8; i += lanes) {
+      const __m256i v = stage.template lanes<T>(load_varint_lanes256(in.data() + i));
+      if (!_mm256_testz_si256(v, _mm256_set1_epi64x(0xff00000000000000LL))) [[unlikely]] {
+        alignas(32) uint64_t values[lanes];
+        _mm256_store_si256(reinterpret_cast<__m256i *>(values), v);
+        for (auto value : values)
+          out = pdep_varint_encoder::encode_one<false>(value, out);
+        continue;
+      }
+
+      __m256i spread = _mm256_and_si256(v, _mm256_set1_epi64x(0x7f));
+      [&]<int... I>(std::integer_sequence<int, I...>) {
+        ((spread = _mm256_or_si256(
+              spread, _mm256_and_si256(_mm256_slli_epi64(v, I + 1),
+                                       _mm256_set1_epi64x(0x7fLL << (CHAR_BIT * (I + 1)))))),
+         ...);
+      }(std::make_integer_sequence<int, 7>());
+
+      alignas(32) uint64_t words[lanes];
+      _mm256_store_si256(reinterpret_cast<__m256i *>(words), spread);
+      for (auto word : words) {
+        // the highest non-zero byte of the spread bits is the last one
+        const int n = (std::bit_width(word | 1) + CHAR_BIT - 1) / CHAR_BIT;
+        word |= 0x0080808080808080ULL >> (CHAR_BIT * (8 - n));
+        memcpy(out, &word, sizeof(word));
+        out += n;
+      }
+    }
+    return pdep_varint_encoder::encode(in.subspan(i), out, stage);
+  }
+};
+#endif
+
+#if defined(__AVX512BW__) && defined(__AVX512VBMI2__)
+// Encodes 8 values below 2^56 per iteration and packs the encoded bytes with
+// a single vpcompressb.
+struct avx512_varint_encoder {
+  template <typename Input = raw_varint_input, typename T>
+  static char *encode(std::span<const T> in, char *out, Input stage = {}) {
+    constexpr std::size_t lanes = 8;
+    std::size_t i = 0;
+    for (; in.size() - i >= lanes && (in.size() - i) * varint_max_size<T> >= 64; i += lanes) {
+      const __m512i v = stage.template lanes<T>(load_varint_lanes512(in.data() + i));
+      if (_mm512_test_epi64_mask(v, _mm512_set1_epi64(0xff00000000000000LL))) [[unlikely]] {
+        alignas(64) uint64_t values[lanes];
+        _mm512_store_si512(values, v);
+        for (auto value : values)
+          out = pdep_varint_encoder::encode_one<false>(value, out);
+        continue;
+      }
+
+      __m512i spread = _mm512_and_si512(v, _mm512_set1_epi64(0x7f));
+      __m512i cont = _mm512_setzero_si512();
+      [&]<int... I>(std::integer_sequence<int, I...>) {
+        ((spread = _mm512_ternarylogic_epi64(
+              spread, _mm512_slli_epi64(v, I + 1),
+              _mm512_set1_epi64(0x7fLL << (CHAR_BIT * (I + 1))), 0xf8)),
+         ...);
+        ((cont = _mm512_mask_or_epi64(
+              cont, _mm512_cmpge_epu64_mask(v, _mm512_set1_epi64(1LL << (7 * (I + 1)))), cont,
+              _mm512_set1_epi64(0x80LL << (CHAR_BIT * I)))),
+         ...);
+      }(std::make_integer_sequence<int, 7>());
+
+      // byte 0 of every lane plus every byte following a continuation byte
+      const __mmask64 keep = (_mm512_movepi8_mask(cont) << 1) | 0x0101010101010101ULL;
+      _mm512_storeu_si512(out, _mm512_maskz_compress_epi8(keep, _mm512_or_si512(spread, cont)));
+      out += std::popcount(keep);
+    }
+    return pdep_varint_encoder::encode(in.subspan(i), out, stage);
+  }
+};
+
+using varint_encoder = avx512_varint_encoder;
+#elif defined(__AVX2__) && !defined(__BMI2__)
+using varint_encoder = avx2_varint_encoder;
+#else
+using varint_encoder = pdep_varint_encoder;
+#endif
+
+// Exact encoded sizes, for planning serialization: the number of bytes the
+// encoders above write for the same values and Input stage, in total or per
+// value, so the output can be allocated once and written without bounds
+// checks where varint_max_size<T> only bounds it. Stateful stages continue
+// like they do when encoding.
+struct scalar_varint_sizer {
+  template <typename Input = raw_varint_input, typename T>
+  static std::size_t encoded_size(std::span<const T> in, Input stage = {}) {
+    std::size_t size = 0;
+    for (auto v : in)
+      size += varint_size(stage(v));
+    return size;
+  }
+
+  template <typename Input = raw_varint_input, typename T>
+  static void encoded_sizes(std::span<const T> in, uint8_t *sizes, Input stage = {}) {
+    for (auto v : in)
+      *sizes++ = static_cast<uint8_t>(varint_size(stage(v)));
+  }
+};
+
+#ifdef __AVX2__
+// Without a vector lzcnt, the size of a lane is 1 plus the number of 7-bit
+// thresholds it reaches, counted with compares.
+struct avx2_varint_sizer {
+  template <typename T>
+  static inline __m256i lane_sizes(__m256i v) {
+    // the compares are signed; 64-bit values are biased into their range
+    constexpr uint64_t bias = sizeof(T) == 8 ? 1ULL << 63 : 0;
+    v = _mm256_xor_si256(v, _mm256_set1_epi64x(bias));
+    __m256i size = _mm256_set1_epi64x(1);
+    [&]<int... I>(std::integer_sequence<int, I...>) {
+      ((size = _mm256_sub_epi64(
+            size, _mm256_cmpgt_epi64(v, _mm256_set1_epi64x(((1ULL << (7 * (I + 1))) - 1) ^ bias)))),
+       ...);
+    }(std::make_integer_sequence<int, varint_max_size<T> - 1>());
+    return size;
+  }
+
+  template <typename Input = raw_varint_input, typename T>
+  static std::size_t encoded_size(std::span<const T> in, Input stage = {}) {
+    constexpr std::size_t lanes = 4;
+    __m256i total = _mm256_setzero_si256();
+    std::size_t i = 0;
+    for (; in.size() - i >= lanes; i += lanes)
+      total = _mm256_add_epi64(total, lane_sizes<T>(stage.template lanes<T>(load_varint_lanes256(in.data() + i))));
+    const __m128i sum = _mm_add_epi64(_mm256_castsi256_si128(total), _mm256_extracti128_si256(total, 1));
+    return _mm_cvtsi128_si64(sum) + _mm_extract_epi64(sum, 1) + scalar_varint_sizer::encoded_size(in.subspan(i), stage);
+  }
+
+  template <typename Input = raw_varint_input, typename T>
+  static void encoded_sizes(std::span<const T> in, uint8_t *sizes, Input stage = {}) {
+    constexpr std::size_t lanes = 4;
+    std::size_t i = 0;
+    for (; in.size() - i >= lanes; i += lanes) {
+      const __m256i size = lane_sizes<T>(stage.template lanes<T>(load_varint_lanes256(in.data() + i)));
+      // the low dword of each lane, narrowed to bytes
+      __m128i packed = _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(size, _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6)));
+      packed = _mm_packus_epi16(_mm_packus_epi32(packed, packed), packed);
+      const int32_t bytes = _mm_cvtsi128_si32(packed);
+      memcpy(sizes + i, &bytes, sizeof(bytes));
+    }
+    scalar_varint_sizer::encoded_sizes(in.subspan(i), sizes + i, stage);
+  }
+};
+#endif
+
+#if defined(__AVX512F__) && defined(__AVX512CD__)
+// varint_size() on 8 lanes, with vplzcntq.
+struct avx512_varint_sizer {
+  static inline __m512i lane_sizes(__m512i v) {
+    const __m512i log2 =
+        _mm512_sub_epi64(_mm512_set1_epi64(63), _mm512_lzcnt_epi64(_mm512_or_si512(v, _mm512_set1_epi64(1))));
+    return _mm512_srli_epi64(
+        _mm512_add_epi64(_mm512_add_epi64(_mm512_slli_epi64(log2, 3), log2), _mm512_set1_epi64(73)), 6);
+  }
+
+  template <typename Input = raw_varint_input, typename T>
+  static std::size_t encoded_size(std::span<const T> in, Input stage = {}) {
+    constexpr std::size_t lanes = 8;
+    __m512i total = _mm512_setzero_si512();
+    std::size_t i = 0;
+    for (; in.size() - i >= lanes; i += lanes)
+      total = _mm512_add_epi64(total, lane_sizes(stage.template lanes<T>(load_varint_lanes512(in.data() + i))));
+    return _mm512_reduce_add_epi64(total) + scalar_varint_sizer::encoded_size(in.subspan(i), stage);
+  }
+
+  template <typename Input = raw_varint_input, typename T>
+  static void encoded_sizes(std::span<const T> in, uint8_t *sizes, Input stage = {}) {
+    constexpr std::size_t lanes = 8;
+    std::size_t i = 0;
+    for (; in.size() - i >= lanes; i += lanes)
+      _mm_storel_epi64(reinterpret_cast<__m128i *>(sizes + i),
+                       _mm512_cvtepi64_epi8(lane_sizes(stage.template lanes<T>(load_varint_lanes512(in.data() + i)))));
+    scalar_varint_sizer::encoded_sizes(in.subspan(i), sizes + i, stage);
+  }
+};
+
+template <typename T>
+using varint_sizer = avx512_varint_sizer;
+#elif defined(__AVX2__)
+// 9 compares per 4 lanes are no faster than scalar lzcnt for 64-bit values,
+// the 4 for 32-bit ones are
+template <typename T>
+using varint_sizer = std::conditional_t<sizeof(T) <= 4, avx2_varint_sizer, scalar_varint_sizer>;
+#else
+template <typename T>
+using varint_sizer = scalar_varint_sizer;
+#endif
+
+// The total size of in encoded through stage.
+template <typename Input = raw_varint_input, typename T>
+std::size_t encoded_size(std::span<const T> in, Input stage = {}) {
+  return varint_sizer<T>::encoded_size(in, stage);
+}
+
+// Writes the encoded size of each value of in through stage to sizes.
+template <typename Input = raw_varint_input, typename T>
+void encoded_sizes(std::span<const T> in, uint8_t *sizes, Input stage = {}) {
+  varint_sizer<T>::encoded_sizes(in, sizes, stage);
+}
@@ -0,0 +1,135 @@
+#pragma once
+#include "checked_varint_parser.h"
+#include "num_varints.h"
+#include "varint_dispatch.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <span>
+#include <system_error>
+#include <utility>
+#include <vector>
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+struct mapped_file_options {
+  // fault the whole file in up front (MAP_POPULATE) instead of page by page
+  // while decoding
+  bool populate = false;
+  // MADV_HUGEPAGE; only honored where the kernel maps page cache with huge
+  // pages, e.g. on tmpfs or with CONFIG_READ_ONLY_THP_FOR_FS
+  bool huge_pages = true;
+  // MADV_SEQUENTIAL, for aggressive read-ahead and early reclaim of the pages
+  // behind
+  bool sequential = true;
+};
+
+// A file of varints mapped read-only. Elsewhere than on Linux the file is read
+// into memory instead. Throws std::system_error when it can't be opened.
+class mapped_varint_file {
+  const char *data_ = nullptr;
+  std::size_t size_ = 0;
+#ifndef __linux__
+  std::vector<char> content;
+#endif
+
+public:
+  explicit mapped_varint_file(const char *path, mapped_file_options options = {}) {
+#ifdef __linux__
+    const int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+      throw std::system_error(errno, std::generic_category(), path);
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+      const int error = errno;
+      close(fd);
+      throw std::system_error(error, std::generic_category(), path);
+    }
+    size_ = static_cast<std::size_t>(st.st_size);
+    if (size_ > 0) {
+      void *p = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE | (options.populate ? MAP_POPULATE : 0), fd, 0);
+      if (p == MAP_FAILED) {
+        const int error = errno;
+        close(fd);
+        throw std::system_error(error, std::generic_category(), path);
+      }
+      if (options.huge_pages)
+        madvise(p, size_, MADV_HUGEPAGE);
+      if (options.sequential)
+        madvise(p, size_, MADV_SEQUENTIAL);
+      data_ = static_cast<const char *>(p);
+    }
+    close(fd);
+#else
+    (void)options;
+    std::FILE *file = std::fopen(path, "rb");
+    if (file == nullptr)
+      throw std::system_error(errno, std::generic_category(), path);
+    char chunk[1 << 16];
+    for (std::size_t n; (n = std::fread(chunk, 1, sizeof(chunk), file)) > 0;)
+      content.insert(content.end(), chunk, chunk + n);
+    std::fclose(file);
+    data_ = content.data();
+    size_ = content.size();
+#endif
+  }
+
+  mapped_varint_file(const mapped_varint_file &) = delete;
+  mapped_varint_file &operator=(const mapped_varint_file &) = delete;
+
+  ~mapped_varint_file() {
+#ifdef __linux__
+    if (data_ != nullptr)
+      munmap(const_cast<char *>(data_), size_);
+#endif
+  }
+
+  const char *data() const { return data_; }
+  std::size_t size() const { return size_; }
+  operator std::span<const char>() const { return {data_, size_}; }
+};
+
+// Decodes data block by block with parse into a buffer of block_bytes values,
+// which is reused, and hands each block's values to consume(std::span<const
+// uint64_t>). Blocks are cut after the last varint ending in the next
+// block_bytes. With the default, a 64 KiB block and its output of up to
+// 512 KiB take at most 576 KiB whatever the file size, which fits the L2 of
+// current server cores; smaller blocks suit smaller caches.
+//
+// Each block is checked with varints_fit_64_bits(), which also counts its
+// varints, before it is decoded, so any kernel can be used on untrusted files.
+// Returns the position decoding stopped at: the end of data, the start of a
+// trailing incomplete varint, or the start of a varint longer than 10 bytes,
+// overflowing 64 bits or longer than block_bytes. The varints before it have
+// been consumed.
+template <typename Consume>
+const char *decode_varint_blocks(std::span<const char> data, varint_parse_fn parse, Consume &&consume,
+                                 std::size_t block_bytes = 64 << 10) {
+  std::vector<uint64_t> values(block_bytes);
+  const char *begin = data.data();
+  const char *end = data.data() + data.size();
+  while (begin < end) {
+    const char *block_end = std::min<const char *>(end, begin + block_bytes);
+    while (block_end > begin && int8_t(block_end[-1]) < 0)
+      --block_end;
+    if (block_end == begin)
+      return begin;
+    std::size_t count;
+    if (!varints_fit_64_bits(begin, block_end, count)) [[unlikely]] {
+      // decode up to the offending varint with the checked parser
+      const auto r = checked_varint_parser<uint64_t>::parse(begin, block_end, values.data());
+      consume(std::span<const uint64_t>(values.data(), num_varints({begin, r.ptr})));
+      return r.ptr;
+    }
+    parse(begin, block_end, values.data());
+    consume(std::span<const uint64_t>(values.data(), count));
+    begin = block_end;
+  }
+  return begin;
+}
@@ -0,0 +1,95 @@
+#pragma once
+#include "checked_varint_parser.h"
+#include "num_varints.h"
+#include "varint_parser.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <system_error>
+#include <vector>
+
+// Sparse index for random access into a buffer of varints: the byte offset of
+// every stride-th varint, found in one pass over the terminator masks. A point
+// lookup or the start of a range scan then skips at most stride - 1 varints
+// from the nearest checkpoint instead of decoding everything before it.
+//
+// The index refers to the buffer it was built on, which must outlive it. Bytes
+// of a varint cut off by the end of the buffer are not part of any varint.
+template <typename T = uint64_t, auto Parse = &ubfx_varint_parser::parse<T>>
+class varint_index {
+  const char *data_begin;
+  const char *data_end;
+  std::size_t stride_;
+  std::size_t size_ = 0;
+  // checkpoints[j] is the offset of varint j * stride
+  std::vector<std::size_t> checkpoints;
+
+public:
+  explicit varint_index(std::span<const char> data, std::size_t stride = 128)
+      : data_begin(data.data()), data_end(data.data() + data.size()), stride_(std::max<std::size_t>(stride, 1)) {
+    checkpoints.reserve(data.size() / stride_ + 1);
+    // the ordinal of the next checkpoint; varint i starts after i terminators
+    std::size_t next = 0;
+    const auto block = [&](const char *p, uint64_t terminators) {
+      const auto c = static_cast<std::size_t>(std::popcount(terminators));
+      if (next == 0) {
+        checkpoints.push_back(0);
+        next = stride_;
+      }
+      for (; next <= size_ + c; next += stride_)
+        checkpoints.push_back(p - data_begin + nth_set_bit(terminators, next - size_ - 1) + 1);
+      size_ += c;
+    };
+    const char *p = data_begin;
+    for (; data_end - p >= 64; p += 64)
+      block(p, varint_terminator_mask(p));
+    if (p < data_end) {
+      alignas(64) char padded[64];
+      memset(padded, 0x80, sizeof(padded));
+      memcpy(padded, p, data_end - p);
+      block(p, varint_terminator_mask(padded));
+    }
+    // a checkpoint at the end of the last varint starts no varint
+    if (!checkpoints.empty() && (checkpoints.size() - 1) * stride_ >= size_)
+      checkpoints.pop_back();
+  }
+
+  // number of complete varints in the buffer
+  std::size_t size() const { return size_; }
+  std::size_t stride() const { return stride_; }
+  std::size_t num_checkpoints() const { return checkpoints.size(); }
+
+  // the position of varint i, or the end of the last complete varint when
+  // i >= size()
+  const char *find(std::size_t i) const {
+    if (checkpoints.empty())
+      return data_begin;
+    if (i >= size_)
+      return skip_varints(data_begin + checkpoints.back(), data_end, SIZE_MAX).first;
+    const char *checkpoint = data_begin + checkpoints[i / stride_];
+    return skip_varints(checkpoint, data_end, i % stride_).first;
+  }
+
+  // Decodes varint i into value; std::errc::result_out_of_range when i is
+  // past the end, and the errors of parse_checked_varint.
+  std::errc at(std::size_t i, T &value) const {
+    if (i >= size_)
+      return std::errc::result_out_of_range;
+    return parse_checked_varint(find(i), data_end, value).ec;
+  }
+
+  // Decodes up to count varints starting with varint first into result and
+  // returns the number decoded.
+  std::size_t read(std::size_t first, std::size_t count, T *result) const {
+    if (first >= size_)
+      return 0;
+    count = std::min(count, size_ - first);
+    const char *begin = find(first);
+    const char *end = skip_varints(begin, data_end, count).first;
+    Parse(begin, end, result);
+    return count;
+  }
+};
@@ -0,0 +1,69 @@
+// Instantiates the kernels for one instruction set level. This file is
+// compiled once per level with VARINT_KERNEL_ARCH naming the namespace the
+// kernels are placed in; varint_dispatch.cpp picks among them at runtime.
+//
+// The headers are included inside that namespace so that inline functions
+// compiled with different target flags never get merged by the linker. Every
+// header they depend on is included beforehand, at global scope.
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <immintrin.h>
+#include <iterator>
+#include <new>
+#include <numeric>
+#include <span>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+#if __has_include(<experimental/simd>)
+#include <experimental/simd>
+#endif
+
+namespace VARINT_KERNEL_ARCH {
+#include "num_varints.h"
+#include "parse_varint.h"
+#include "varint_parser.h"
+
+const char *parse_shift_mix(const char *begin, const char *end, uint64_t *result) {
+  while (begin < end) {
+    int64_t v;
+    begin = shift_mix_parse_varint<uint64_t>(begin, v);
+    *result++ = static_cast<uint64_t>(v);
+  }
+  return begin;
+}
+
+const char *parse_ubfx(const char *begin, const char *end, uint64_t *result) {
+  return ubfx_varint_parser::parse(begin, end, result);
+}
+
+#ifdef __BMI2__
+const char *parse_bmi(const char *begin, const char *end, uint64_t *result) {
+  bmi_varint_parser<6, uint64_t> parser;
+  return parser.parse(begin, end, result);
+}
+#endif
+
+#ifdef __AVX2__
+const char *parse_masked_vbyte(const char *begin, const char *end, uint64_t *result) {
+  return masked_vbyte_parser<32>::parse(begin, end, result);
+}
+#endif
+
+#ifdef __AVX512BW__
+const char *parse_masked_vbyte512(const char *begin, const char *end, uint64_t *result) {
+  return masked_vbyte_parser<64>::parse(begin, end, result);
+}
+#endif
+
+std::size_t count_varints(std::span<const char> range) { return num_varints(range); }
+} // namespace VARINT_KERNEL_ARCH
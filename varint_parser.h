@@ -1,14 +1,167 @@
 
+#pragma once
+#include "parse_varint.h"
+#include "varint_buffer.h"
+#include "varint_stats.h"
+
+#include <algorithm>
+#include <array>
 #include <bit>
 #include <cstdint>
 #include <cstring>
 #include <immintrin.h>
+#include <type_traits>
+#include <utility>
+
+// Output stages of the bulk decoders. Every decoded value goes through one on
+// its way to the output, so transforms like zigzag decoding need no second
+// pass over memory. lanes<T>() transforms a vector of sizeof(T) lanes.
+struct raw_varint_output {
+  uint64_t operator()(uint64_t v) { return v; }
+#ifdef __AVX2__
+  template <typename T, typename V>
+  V lanes(V v) { return v; }
+#endif
+};
+
+// For protobuf sint32/sint64 fields, see zigzag_decode().
+struct zigzag_varint_output {
+  uint64_t operator()(uint64_t v) { return zigzag_decode<int64_t>(v); }
+#ifdef __AVX2__
+  template <typename T>
+  __m128i lanes(__m128i v) {
+    if constexpr (sizeof(T) == 8)
+      return _mm_xor_si128(_mm_srli_epi64(v, 1), _mm_sub_epi64(_mm_setzero_si128(),
+                                                               _mm_and_si128(v, _mm_set1_epi64x(1))));
+    else
+      return _mm_xor_si128(_mm_srli_epi32(v, 1), _mm_sub_epi32(_mm_setzero_si128(),
+                                                               _mm_and_si128(v, _mm_set1_epi32(1))));
+  }
+
+  template <typename T>
+  __m256i lanes(__m256i v) {
+    if constexpr (sizeof(T) == 8)
+      return _mm256_xor_si256(_mm256_srli_epi64(v, 1), _mm256_sub_epi64(_mm256_setzero_si256(),
+                                                                        _mm256_and_si256(v, _mm256_set1_epi64x(1))));
+    else
+      return _mm256_xor_si256(_mm256_srli_epi32(v, 1), _mm256_sub_epi32(_mm256_setzero_si256(),
+                                                                        _mm256_and_si256(v, _mm256_set1_epi32(1))));
+  }
+#endif
+};
+
+// For delta encoded sequences such as timestamps or posting lists: each value
+// is the running sum of the Inner stage's output, starting from base. Use
+// zigzag_varint_output as Inner for series that aren't monotonic. The vector
+// overloads compute the prefix sum of a whole vector with log2(lanes) shifted
+// adds.
+template <typename Inner = raw_varint_output>
+struct delta_varint_output {
+  uint64_t base = 0;
+  [[no_unique_address]] Inner inner;
+
+  uint64_t operator()(uint64_t v) { return base += inner(v); }
+
+#ifdef __AVX2__
+  template <typename T>
+  __m128i lanes(__m128i v) {
+    v = inner.template lanes<T>(v);
+    if constexpr (sizeof(T) == 8) {
+      v = _mm_add_epi64(v, _mm_slli_si128(v, 8));
+      v = _mm_add_epi64(v, _mm_set1_epi64x(base));
+      base = _mm_extract_epi64(v, 1);
+    } else {
+      v = _mm_add_epi32(v, _mm_slli_si128(v, 4));
+      v = _mm_add_epi32(v, _mm_slli_si128(v, 8));
+      v = _mm_add_epi32(v, _mm_set1_epi32(static_cast<int>(base)));
+      base = static_cast<uint32_t>(_mm_extract_epi32(v, 3));
+    }
+    return v;
+  }
+
+  template <typename T>
+  __m256i lanes(__m256i v) {
+    v = inner.template lanes<T>(v);
+    if constexpr (sizeof(T) == 8) {
+      const __m256i zero = _mm256_setzero_si256();
+      v = _mm256_add_epi64(v, _mm256_blend_epi32(_mm256_permute4x64_epi64(v, _MM_SHUFFLE(2, 1, 0, 0)), zero, 0x03));
+      v = _mm256_add_epi64(v, _mm256_blend_epi32(_mm256_permute4x64_epi64(v, _MM_SHUFFLE(1, 0, 0, 0)), zero, 0x0f));
+      v = _mm256_add_epi64(v, _mm256_set1_epi64x(base));
+      base = _mm256_extract_epi64(v, 3);
+    } else {
+      // prefix sums of the 128-bit halves, then the low half's total is added
+      // to the high half
+      v = _mm256_add_epi32(v, _mm256_slli_si256(v, 4));
+      v = _mm256_add_epi32(v, _mm256_slli_si256(v, 8));
+      v = _mm256_add_epi32(v, _mm256_shuffle_epi32(_mm256_permute2x128_si256(v, v, 0x08), _MM_SHUFFLE(3, 3, 3, 3)));
+      v = _mm256_add_epi32(v, _mm256_set1_epi32(static_cast<int>(base)));
+      base = static_cast<uint32_t>(_mm256_extract_epi32(v, 7));
+    }
+    return v;
+  }
+#endif
+};
+
+// Reduction sinks. A bulk decoder instantiated with a sink type as T takes a
+// pointer to the sink in place of the output array and hands it the decoded
+// values instead of storing them, so an aggregate or a filter over a column
+// needs no array to store to and read back. value_type is the type of the
+// values, and the lane width of the vectors it receives: operator() takes one
+// value and lanes() a vector whose first count lanes hold the next values.
+// See varint_sinks.h.
+template <typename S>
+concept varint_sink = requires(S &sink, uint64_t v) {
+  typename S::value_type;
+  sink(v);
+};
+
+template <typename T>
+struct varint_output_traits {
+  using value_type = T;
+};
+
+template <varint_sink S>
+struct varint_output_traits<S> {
+  using value_type = typename S::value_type;
+};
+
+// the type of the values written through a T *
+template <typename T>
+using varint_value_t = typename varint_output_traits<T>::value_type;
 
-template <int MaskLength, typename T>
+template <typename T>
+__attribute__((always_inline)) inline void varint_put(T *&out, uint64_t v) {
+  if constexpr (varint_sink<T>)
+    (*out)(v);
+  else
+    *out++ = static_cast<T>(v);
+}
+
+#ifdef __AVX2__
+// Writes the first count lanes of v. Arrays get the whole vector, the lanes
+// past count being overwritten by the values that follow.
+template <typename T, typename V>
+__attribute__((always_inline)) inline void varint_put_lanes(T *&out, V v, int count) {
+  if constexpr (varint_sink<T>) {
+    out->lanes(v, count);
+  } else {
+    if constexpr (sizeof(V) == 32)
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(out), v);
+    else
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(out), v);
+    out += count;
+  }
+}
+#endif
+
+template <int MaskLength, typename T, typename Output = raw_varint_output>
 struct bmi_varint_parser {
+  static_assert(MaskLength >= 1 && MaskLength <= 8, "a word is loaded with 8 byte loads");
+
   T *res;
   int shift_bits = 0;
   uint64_t pt_val = 0;
+  [[no_unique_address]] Output stage;
 
   static consteval int calc_shift_bits(unsigned sign_bits) {
     unsigned mask = 1 << (MaskLength - 1);
@@ -28,8 +181,8 @@ struct bmi_varint_parser {
 
   static constexpr auto word_mask = calc_word_mask();
   static consteval uint64_t calc_extract_mask(uint64_t sign_bits) {
-    int64_t extract_mask = 0x7fULL;
-    for (int i = 0; i < std::countr_one(sign_bits); ++i) {
+    uint64_t extract_mask = 0x7fULL;
+    for (int i = 0; i < std::min(std::countr_one(sign_bits), MaskLength - 1); ++i) {
       extract_mask <<= CHAR_BIT;
       extract_mask |= 0x7fULL;
     }
@@ -46,7 +199,7 @@ struct bmi_varint_parser {
 #endif
   }
 
-  __attribute__((always_inline)) void output(uint64_t v) { *res++ = static_cast<T>(v); }
+  __attribute__((always_inline)) void output(uint64_t v) { varint_put(res, stage(v)); }
 
   template <uint64_t SignBits, int I>
   inline void output(uint64_t word, uint64_t &extract_mask) {
@@ -66,7 +219,8 @@ struct bmi_varint_parser {
     if constexpr (std::countr_one(SignBits) < MaskLength) {
       output((pext_u64(word, extract_mask) << shift_bits) | pt_val);
       constexpr unsigned bytes_processed = std::countr_one(SignBits) + 1;
-      extract_mask = 0x7fULL << (CHAR_BIT * bytes_processed);
+      if constexpr (bytes_processed < MaskLength)
+        extract_mask = 0x7fULL << (CHAR_BIT * bytes_processed);
       output<SignBits, bytes_processed>(word, extract_mask);
       pt_val = 0;
       shift_bits = 0;
@@ -79,17 +233,30 @@ struct bmi_varint_parser {
     shift_bits += calc_shift_bits(SignBits);
   }
 
+  template <uint64_t SignBits>
+  static void parse_word_as(bmi_varint_parser &parser, uint64_t word) {
+    parser.fixed_masked_parse<SignBits>(word);
+  }
+
+  // Jump table indexed by the continuation bits of a word, so every word costs
+  // a single indirect branch whatever the compiler does with long if chains.
+  using word_handler = void (*)(bmi_varint_parser &, uint64_t);
   template <std::size_t... I>
-  __attribute__((always_inline)) void parse_word(uint64_t masked_bits, uint64_t word, std::index_sequence<I...>) {
-    (void)((masked_bits == I && (fixed_masked_parse<I>(word), true)) || ...);
+  static consteval std::array<word_handler, sizeof...(I)> make_word_handlers(std::index_sequence<I...>) {
+    return {&parse_word_as<I>...};
+  }
+  static constexpr auto word_handlers = make_word_handlers(std::make_index_sequence<1 << MaskLength>());
+
+  __attribute__((always_inline)) void parse_word(uint64_t masked_bits, uint64_t word) {
+    word_handlers[masked_bits](*this, word);
   }
 
   const char *parse_partial(const char *begin, const char *end) {
-    for (; end - begin >= MaskLength; begin += MaskLength) {
+    for (; end - begin >= static_cast<std::ptrdiff_t>(sizeof(uint64_t)); begin += MaskLength) {
       uint64_t word;
       memcpy(&word, begin, sizeof(word));
       auto mval = pext_u64(word, word_mask);
-      parse_word(mval, word, std::make_index_sequence<1 << MaskLength>());
+      parse_word(mval, word);
     }
     return begin;
   }
@@ -102,6 +269,7 @@ struct bmi_varint_parser {
     int bytes_left = end - begin;
     uint64_t word = 0;
     memcpy(&word, begin, bytes_left);
+    varint_stats::add(varint_stats::bmi_tail_bytes, bytes_left);
     for (; bytes_left > 0; --bytes_left, word >>= CHAR_BIT) {
       pt_val |= ((word & 0x7fULL) << shift_bits);
       if (word & 0x80ULL) {
@@ -114,9 +282,31 @@ struct bmi_varint_parser {
     }
     return end;
   }
+
+  // The bytes past the end of the buffer are taken as continuation bytes in the
+  // last word, so they produce no output.
+  template <std::size_t Padding, std::size_t Alignment>
+  const char *parse(const varint_buffer<Padding, Alignment> &buffer, T *result) {
+    static_assert(Padding >= sizeof(uint64_t));
+    res = result;
+    auto begin = buffer.data();
+    auto end = begin + buffer.size();
+    for (; begin < end; begin += MaskLength) {
+      uint64_t word;
+      memcpy(&word, begin, sizeof(word));
+      auto mval = pext_u64(word, word_mask);
+      if (end - begin < MaskLength)
+        mval |= (~0ULL << (end - begin)) & ((1ULL << MaskLength) - 1);
+      parse_word(mval, word);
+    }
+    pt_val = 0;
+    shift_bits = 0;
+    return end;
+  }
 };
 
-struct ubfx_varint_parser {
+template <typename Output = raw_varint_output>
+struct basic_ubfx_varint_parser {
 
   template <uint32_t lsb, uint32_t width>
   inline static constexpr uint64_t ubfx(uint64_t src) {
@@ -170,44 +360,322 @@ struct ubfx_varint_parser {
 #endif
   }
 
-  template <typename T>
-  static inline const char *parse(const char *begin, const char *end,
-                                  T *result) {
-    while (end - begin >= 8) {
+  // With Padded, the words may extend past end; the 1-byte path then stops at
+  // end instead of decoding the zeroed padding.
+  template <bool Padded, typename T, typename Stage>
+  static inline const char *parse_words(const char *begin, const char *end,
+                                        T *&result, Stage &stage) {
+    while (Padded ? begin < end : end - begin >= 8) {
       uint64_t word;
       memcpy(&word, begin, sizeof(word));
 
       int width = 1 + std::countr_one(word | 0x7f7f7f7f7f7f7f7fULL) / 8;
       if (width == 1) {
         auto x = std::bit_cast<std::array<int8_t, 8>>(word);
+        const int n = Padded ? std::min<std::ptrdiff_t>(8, end - begin) : 8;
         int i;
-        for (i = 0; x[i] >= 0 && i < 8; ++i) {
-          *result++ = static_cast<T>(x[i]);
+        for (i = 0; i < n && x[i] >= 0; ++i) {
+          varint_put(result, stage(uint64_t(x[i])));
         }
         begin += i;
       } else if (width == 9) {
+        varint_stats::add(varint_stats::ubfx_long_varints);
         int8_t next_byte = static_cast<int8_t>(*(begin + 8));
-        *result++ =
-            extract_bytes(word, 8) | (static_cast<uint64_t>(next_byte) << 56);
-        if (next_byte > 0) [[likely]] {
+        varint_put(result, stage(extract_bytes(word, 8) | (static_cast<uint64_t>(next_byte) << 56)));
+        if (next_byte >= 0) [[likely]] {
           begin += 9;
         } else {
-          if (static_cast<int8_t>(*(begin + 9)) == -1) [[likely]]
+          if (*(begin + 9) == 1) [[likely]]
             begin += 10;
           else
             return end + 1; // error
         }
       } else {
-        *result++ = extract_bytes(word, width);
+        varint_put(result, stage(extract_bytes(word, width)));
         begin += width;
       }
     }
+    return begin;
+  }
+
+  template <typename T>
+  static inline const char *parse(const char *begin, const char *end,
+                                  T *result) {
+    Output stage;
+    return parse(begin, end, result, stage);
+  }
+
+  // Continues with the state of a stateful stage, e.g. the base of
+  // delta_varint_output when the input comes in pieces.
+  template <typename T, typename Stage>
+  static inline const char *parse(const char *begin, const char *end,
+                                  T *result, Stage &stage) {
+    using value_type = varint_value_t<T>;
+    begin = parse_words<false>(begin, end, result, stage);
+    if (begin > end) [[unlikely]]
+      return begin;
 
     while (begin < end) {
+      varint_stats::add(varint_stats::ubfx_tail_varints);
       int64_t v;
-      begin = shift_mix_parse_varint<T>(begin, v);
-      *result++ = static_cast<T>(v);
+      begin = shift_mix_parse_varint<value_type>(begin, v);
+      varint_put(result, stage(static_cast<std::make_unsigned_t<value_type>>(v)));
     }
     return begin;
   }
+
+  template <typename T, std::size_t Padding, std::size_t Alignment>
+  static inline const char *parse(const varint_buffer<Padding, Alignment> &buffer,
+                                  T *result) {
+    static_assert(Padding >= 10);
+    Output stage;
+    return parse_words<true>(buffer.data(), buffer.data() + buffer.size(), result, stage);
+  }
 };
+
+using ubfx_varint_parser = basic_ubfx_varint_parser<>;
+
+#ifdef __AVX2__
+// Lookup tables for masked_vbyte_parser. Each entry is indexed by the
+// continuation bits of the next 12 input bytes and describes how to decode the
+// leading complete varints within those bytes with a single pshufb:
+//   - kind 1: up to 8 varints of at most 2 bytes, into 16-bit lanes;
+//   - kind 2: up to 4 varints of at most 4 bytes, into 32-bit lanes;
+//   - kind 3: up to 2 varints of at most 8 bytes, into 64-bit lanes;
+//   - kind 0: the first varint is longer than 8 bytes, decode it in scalar.
+struct masked_vbyte_table {
+  struct entry {
+    uint8_t kind;
+    uint8_t count;
+    uint8_t consumed;
+    uint16_t shuffle;
+  };
+
+  std::array<entry, 1 << 12> entries;
+  // 663 distinct shuffles are needed
+  std::array<std::array<uint8_t, 16>, 1024> shuffles;
+  uint16_t num_shuffles = 0;
+
+  static const masked_vbyte_table &get() {
+    static const masked_vbyte_table table;
+    return table;
+  }
+
+private:
+  masked_vbyte_table() {
+    for (unsigned mask = 0; mask < entries.size(); ++mask) {
+      std::array<int, 12> lengths{};
+      int num_lengths = 0;
+      for (int pos = 0, i = 0; i < 12; ++i) {
+        if ((mask & (1U << i)) == 0) {
+          lengths[num_lengths++] = i + 1 - pos;
+          pos = i + 1;
+        }
+      }
+
+      // count the leading varints fitting in each lane width, capped at the
+      // number of lanes; the widest count wins with the narrowest lanes on ties
+      constexpr int lane_bytes[] = {2, 4, 8};
+      constexpr int max_lengths[] = {2, 4, 8};
+      entry e{};
+      for (int k = 0; k < 3; ++k) {
+        int n = 0;
+        while (n < num_lengths && n < 16 / lane_bytes[k] &&
+               lengths[n] <= max_lengths[k])
+          ++n;
+        if (n > e.count) {
+          e.kind = k + 1;
+          e.count = n;
+        }
+      }
+
+      std::array<uint8_t, 16> shuffle;
+      shuffle.fill(0x80);
+      if (e.kind != 0) {
+        const int width = lane_bytes[e.kind - 1];
+        for (int n = 0; n < e.count; ++n) {
+          for (int b = 0; b < lengths[n]; ++b)
+            shuffle[n * width + b] = e.consumed + b;
+          e.consumed += lengths[n];
+        }
+      }
+      // plain arrays and a linear search rather than std containers: this
+      // header is compiled for several instruction sets, see varint_kernels.cpp
+      e.shuffle = std::find(shuffles.begin(), shuffles.begin() + num_shuffles, shuffle) -
+                  shuffles.begin();
+      if (e.shuffle == num_shuffles)
+        shuffles[num_shuffles++] = shuffle;
+      entries[mask] = e;
+    }
+  }
+};
+
+// Bulk decoder in the style of Masked VByte: the continuation bits of a 32 or
+// 64 byte vector are gathered with a single movemask, runs of 1-byte varints
+// are widened directly and everything else is decoded 2 to 8 values at a time
+// through the shuffle tables above. A varint longer than 10 bytes stops it with
+// end + 1, as for ubfx_varint_parser.
+template <int VectorBytes = 32, typename Output = raw_varint_output>
+struct masked_vbyte_parser {
+  static_assert(VectorBytes == 32 || VectorBytes == 64);
+#ifndef __AVX512BW__
+  static_assert(VectorBytes == 32, "64 byte vectors require AVX-512BW");
+#endif
+
+  using mask_type = std::conditional_t<VectorBytes == 32, uint32_t, uint64_t>;
+
+  static inline mask_type continuation_mask(const char *p) {
+#ifdef __AVX512BW__
+    if constexpr (VectorBytes == 64)
+      return _mm512_movepi8_mask(_mm512_loadu_si512(p));
+#endif
+    return static_cast<uint32_t>(_mm256_movemask_epi8(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p))));
+  }
+
+  // widen 16 bytes of 1-byte varints and advance result past them
+  template <typename T, typename Stage>
+  __attribute__((always_inline)) static inline void output_bytes(__m128i v, T *&result, Stage &stage) {
+    using value_type = varint_value_t<T>;
+    if constexpr (sizeof(value_type) == 8) {
+      varint_put_lanes(result, stage.template lanes<value_type>(_mm256_cvtepu8_epi64(v)), 4);
+      varint_put_lanes(result, stage.template lanes<value_type>(_mm256_cvtepu8_epi64(_mm_srli_si128(v, 4))), 4);
+      varint_put_lanes(result, stage.template lanes<value_type>(_mm256_cvtepu8_epi64(_mm_srli_si128(v, 8))), 4);
+      varint_put_lanes(result, stage.template lanes<value_type>(_mm256_cvtepu8_epi64(_mm_srli_si128(v, 12))), 4);
+    } else {
+      varint_put_lanes(result, stage.template lanes<value_type>(_mm256_cvtepu8_epi32(v)), 8);
+      varint_put_lanes(result, stage.template lanes<value_type>(_mm256_cvtepu8_epi32(_mm_srli_si128(v, 8))), 8);
+    }
+  }
+
+  // writes the first count lanes of a shuffled vector of the given kind and
+  // advances result past them; the lanes past count are zero
+  template <typename T, typename Stage>
+  __attribute__((always_inline)) static inline void output_lanes(int kind, __m128i v, int count, T *&result, Stage &stage) {
+    using value_type = varint_value_t<T>;
+    if (kind == 1) {
+      v = _mm_or_si128(_mm_and_si128(v, _mm_set1_epi16(0x7f)),
+                       _mm_srli_epi16(_mm_and_si128(v, _mm_set1_epi16(0x7f00)), 1));
+      if constexpr (sizeof(value_type) == 8) {
+        // in order, for stateful stages
+        const __m256i lo = stage.template lanes<value_type>(_mm256_cvtepu16_epi64(v));
+        const __m256i hi = stage.template lanes<value_type>(_mm256_cvtepu16_epi64(_mm_srli_si128(v, 8)));
+        if constexpr (varint_sink<T>) {
+          varint_put_lanes(result, lo, std::min(count, 4));
+          if (count > 4)
+            varint_put_lanes(result, hi, count - 4);
+        } else {
+          _mm256_storeu_si256(reinterpret_cast<__m256i *>(result), lo);
+          _mm256_storeu_si256(reinterpret_cast<__m256i *>(result) + 1, hi);
+          result += count;
+        }
+      } else {
+        varint_put_lanes(result, stage.template lanes<value_type>(_mm256_cvtepu16_epi32(v)), count);
+      }
+    } else if (kind == 2) {
+      __m128i r = _mm_and_si128(v, _mm_set1_epi32(0x7f));
+      r = _mm_or_si128(r, _mm_and_si128(_mm_srli_epi32(v, 1), _mm_set1_epi32(0x7f << 7)));
+      r = _mm_or_si128(r, _mm_and_si128(_mm_srli_epi32(v, 2), _mm_set1_epi32(0x7f << 14)));
+      r = _mm_or_si128(r, _mm_and_si128(_mm_srli_epi32(v, 3), _mm_set1_epi32(0x7f << 21)));
+      if constexpr (sizeof(value_type) == 8)
+        varint_put_lanes(result, stage.template lanes<value_type>(_mm256_cvtepu32_epi64(r)), count);
+      else
+        varint_put_lanes(result, stage.template lanes<value_type>(r), count);
+    } else {
+      __m128i r = _mm_and_si128(v, _mm_set1_epi64x(0x7f));
+      [&]<int... I>(std::integer_sequence<int, I...>) {
+        ((r = _mm_or_si128(r, _mm_and_si128(_mm_srli_epi64(v, I + 1),
+                                            _mm_set1_epi64x(0x7fLL << (7 * (I + 1)))))),
+         ...);
+      }(std::make_integer_sequence<int, 7>());
+      if constexpr (sizeof(value_type) == 8) {
+        varint_put_lanes(result, stage.template lanes<value_type>(r), count);
+      } else {
+        r = stage.template lanes<value_type>(_mm_shuffle_epi32(r, _MM_SHUFFLE(3, 1, 2, 0)));
+        if constexpr (varint_sink<T>) {
+          varint_put_lanes(result, r, count);
+        } else {
+          _mm_storel_epi64(reinterpret_cast<__m128i *>(result), r);
+          result += count;
+        }
+      }
+    }
+  }
+
+  // decodes the e.count varints at begin described by table entry e, with kind
+  // 1 to 3, and advances result past them; mask holds the continuation bits of
+  // the vector at begin
+  template <typename T, typename Stage>
+  __attribute__((always_inline)) static inline void output_entry(const masked_vbyte_table &table, const masked_vbyte_table::entry &e,
+                                  mask_type mask, const char *begin, T *&result, Stage &stage) {
+    const __m128i shuffle = _mm_loadu_si128(
+        reinterpret_cast<const __m128i *>(table.shuffles[e.shuffle].data()));
+    const __m128i v = _mm_shuffle_epi8(
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(begin)), shuffle);
+
+    // every lane may be written to an array; that's only safe when the vector
+    // holds at least as many varint terminators as there are lanes
+    const int lanes = 16 >> e.kind;
+    if (varint_sink<T> || std::popcount(static_cast<mask_type>(~mask)) >= lanes) [[likely]] {
+      output_lanes(e.kind, v, e.count, result, stage);
+    } else {
+      // the stage only sees the lanes holding values
+      using value_type = varint_value_t<T>;
+      alignas(32) value_type lanes_buffer[8];
+      value_type *lanes_out = lanes_buffer;
+      raw_varint_output raw;
+      output_lanes(e.kind, v, e.count, lanes_out, raw);
+      for (int i = 0; i < e.count; ++i)
+        varint_put(result, stage(static_cast<std::make_unsigned_t<value_type>>(lanes_buffer[i])));
+    }
+  }
+
+  template <typename T>
+  static const char *parse(const char *begin, const char *end, T *result) {
+    Output stage;
+    return parse(begin, end, result, stage);
+  }
+
+  // Continues with the state of a stateful stage, see basic_ubfx_varint_parser.
+  template <typename T, typename Stage>
+  static const char *parse(const char *begin, const char *end, T *result, Stage &stage) {
+    using value_type = varint_value_t<T>;
+    static_assert(sizeof(value_type) == 4 || sizeof(value_type) == 8);
+    const auto &table = masked_vbyte_table::get();
+
+    while (end - begin >= VectorBytes) {
+      mask_type mask = continuation_mask(begin);
+      if (mask == 0) {
+        for (int i = 0; i < VectorBytes; i += 16)
+          output_bytes(_mm_loadu_si128(reinterpret_cast<const __m128i *>(begin + i)), result, stage);
+        begin += VectorBytes;
+        continue;
+      }
+
+      const auto &e = table.entries[mask & 0xfff];
+      if (e.kind == 0) [[unlikely]] {
+        varint_stats::add(varint_stats::masked_vbyte_scalar_varints);
+        int64_t v;
+        begin = shift_mix_parse_varint<value_type>(begin, v);
+        if (begin == nullptr) [[unlikely]]
+          return end + 1; // error
+        varint_put(result, stage(static_cast<std::make_unsigned_t<value_type>>(v)));
+        continue;
+      }
+
+      output_entry(table, e, mask, begin, result, stage);
+      begin += e.consumed;
+    }
+
+    while (begin < end) {
+      varint_stats::add(varint_stats::masked_vbyte_tail_varints);
+      int64_t v;
+      begin = shift_mix_parse_varint<value_type>(begin, v);
+      if (begin == nullptr) [[unlikely]]
+        return end + 1; // error
+      varint_put(result, stage(static_cast<std::make_unsigned_t<value_type>>(v)));
+    }
+    return begin;
+  }
+};
+#endif
@@ -0,0 +1,125 @@
+// Decodes varints streamed from a file or standard input through
+// decode_varint_pipeline and reports the ingest throughput:
+//
+//   varint_pipeline [options] [FILE]
+//
+//   --decoder NAME    kernel of varint_dispatch, default the best for the CPU
+//   --workers N       decoder threads, default 1
+//   --chunk-size N    bytes per chunk, default 1048576
+//   --depth N         chunks per worker, default 4
+//   --list            list the kernels the CPU supports
+//
+// e.g. zcat column.varints.gz | varint_pipeline --workers 2
+#include "varint_dispatch.h"
+#include "varint_pipeline.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <string_view>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+void usage(const char *program) {
+  std::fprintf(stderr, "usage: %s [--decoder NAME] [--workers N] [--chunk-size N] [--depth N] [--list] [FILE]\n",
+               program);
+  std::exit(2);
+}
+
+const varint_decoder *decoder = &selected_varint_decoder();
+
+// decode_varint_pipeline takes its kernel as a template argument
+const char *parse_with_decoder(const char *begin, const char *end, uint64_t *result) {
+  return decoder->parse(begin, end, result);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  varint_pipeline_options options;
+  const char *path = nullptr;
+
+  for (int i = 1; i < argc; ++i) {
+    const std::string_view arg = argv[i];
+    const auto number = [&] {
+      if (i + 1 == argc)
+        usage(argv[0]);
+      const auto n = std::strtoull(argv[++i], nullptr, 0);
+      if (n == 0)
+        usage(argv[0]);
+      return n;
+    };
+    if (arg == "--decoder") {
+      if (i + 1 == argc)
+        usage(argv[0]);
+      const std::string_view name = argv[++i];
+      decoder = nullptr;
+      for (const auto &d : supported_varint_decoders())
+        if (d.name == name)
+          decoder = &d;
+      if (decoder == nullptr) {
+        std::fprintf(stderr, "unknown or unsupported decoder %.*s, see --list\n", int(name.size()), name.data());
+        return 2;
+      }
+    } else if (arg == "--workers") {
+      options.workers = static_cast<unsigned>(number());
+    } else if (arg == "--chunk-size") {
+      options.chunk_bytes = number();
+    } else if (arg == "--depth") {
+      options.depth = static_cast<unsigned>(number());
+    } else if (arg == "--list") {
+      for (const auto &d : supported_varint_decoders())
+        std::printf("%.*s\n", int(d.name.size()), d.name.data());
+      return 0;
+    } else if (arg.starts_with("-") || path != nullptr) {
+      usage(argv[0]);
+    } else {
+      path = argv[i];
+    }
+  }
+
+  const int fd = path == nullptr ? STDIN_FILENO : open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    std::perror(path);
+    return 1;
+  }
+#ifdef POSIX_FADV_SEQUENTIAL
+  posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+  // one checksum per worker, each only touched by its thread
+  struct alignas(64) worker_checksum {
+    uint64_t sum = 0;
+  };
+  std::vector<worker_checksum> checksums(options.workers);
+  const auto consume = [&](std::size_t sequence, std::span<const uint64_t> values) {
+    auto &checksum = checksums[sequence % options.workers].sum;
+    for (auto v : values)
+      checksum += v;
+  };
+
+  const auto start = std::chrono::steady_clock::now();
+  const varint_pipeline_result result = decode_varint_pipeline<&parse_with_decoder>(fd, consume, options);
+  const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  uint64_t checksum = 0;
+  for (auto c : checksums)
+    checksum += c.sum;
+  std::printf("decoder    %.*s\n", int(decoder->name.size()), decoder->name.data());
+  std::printf("workers    %u\n", options.workers);
+  std::printf("bytes      %zu\n", result.bytes);
+  std::printf("varints    %zu\n", result.varints);
+  std::printf("checksum   %016llx\n", static_cast<unsigned long long>(checksum));
+  std::printf("elapsed    %.3f ms, %.2f GB/s\n", seconds * 1e3, seconds > 0 ? result.bytes / seconds * 1e-9 : 0.0);
+  if (result.ec != std::errc{}) {
+    std::fprintf(stderr, "%s: %s\n", path == nullptr ? "stdin" : path,
+                 std::make_error_code(result.ec).message().c_str());
+    return 1;
+  }
+  return 0;
+}
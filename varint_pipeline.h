@@ -0,0 +1,173 @@
+#pragma once
+#include "checked_varint_parser.h"
+#include "num_varints.h"
+#include "spsc_ring.h"
+#include "varint_parser.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <span>
+#include <system_error>
+#include <thread>
+#include <vector>
+#ifdef __unix__
+#include <unistd.h>
+#endif
+
+// Streaming decoder for varints read from a pipe, socket or file: a reader
+// stage fills chunks with read(2) and hands them to decoder workers through
+// spsc_rings, so reading and decoding overlap and the throughput is that of
+// the slower of the two rather than their sum.
+//
+// The reader cuts every chunk after its last varint terminator and carries the
+// bytes of the incomplete varint over to the front of the next chunk, so
+// workers decode whole chunks with the plain bulk kernels. Chunk i goes to
+// worker i % workers. Each worker has its own pool of chunks, returned to the
+// reader through a second ring, and its own output buffer, so the steady state
+// allocates nothing.
+
+struct varint_pipeline_options {
+  std::size_t chunk_bytes = 1 << 20;
+  unsigned workers = 1;
+  // chunks per worker, in flight or waiting to be filled
+  unsigned depth = 4;
+};
+
+// ec is
+//   - the error of read(2);
+//   - std::errc::invalid_argument when the input ends inside a varint;
+//   - std::errc::value_too_large for varints longer than 10 bytes or
+//     overflowing 64 bits.
+// The varints of the chunks before the error have been consumed. Other workers
+// may also have consumed a few chunks after it before they saw the error;
+// varints counts the values consumed.
+struct varint_pipeline_result {
+  std::size_t bytes = 0;
+  std::size_t varints = 0;
+  std::errc ec{};
+};
+
+#ifdef __unix__
+// Decodes the varints read from fd until end of file. consume(sequence,
+// std::span<const uint64_t>) receives the values of each chunk, numbered from
+// 0 in input order, on the thread of the chunk's worker; chunks of different
+// workers are consumed concurrently. Workers check each chunk with
+// varints_fit_64_bits() before decoding it, so Parse can be any of the
+// unchecked kernels. After a chunk fails the check, workers skip the chunks
+// behind it and the reader stops reading.
+template <auto Parse = &ubfx_varint_parser::parse<uint64_t>, typename Consume>
+varint_pipeline_result decode_varint_pipeline(int fd, Consume &&consume, varint_pipeline_options options = {}) {
+  struct chunk {
+    std::unique_ptr<char[]> data;
+    std::size_t size = 0;
+    std::size_t sequence = 0;
+  };
+
+  struct worker {
+    spsc_ring<chunk *> full;
+    spsc_ring<chunk *> free;
+    std::vector<chunk> pool;
+    std::size_t varints = 0;
+
+    worker(std::size_t depth, std::size_t chunk_bytes) : full(depth), free(depth), pool(depth) {
+      for (auto &c : pool) {
+        c.data = std::make_unique<char[]>(chunk_bytes);
+        free.push(&c);
+      }
+    }
+  };
+
+  const std::size_t chunk_bytes = std::max<std::size_t>(options.chunk_bytes, 16);
+  const unsigned num_workers = std::max(options.workers, 1U);
+  std::vector<std::unique_ptr<worker>> workers;
+  for (unsigned w = 0; w < num_workers; ++w)
+    workers.push_back(std::make_unique<worker>(std::max(options.depth, 1U), chunk_bytes));
+  // the sequence of the first chunk with a varint that doesn't fit
+  std::atomic<std::size_t> first_too_long{SIZE_MAX};
+
+  varint_pipeline_result result;
+  {
+    std::vector<std::jthread> threads;
+    for (auto &w : workers) {
+      threads.emplace_back([&, self = w.get()] {
+        std::vector<uint64_t> values(chunk_bytes);
+        while (chunk *c = self->full.pop()) {
+          const char *end = c->data.get() + c->size;
+          if (c->sequence < first_too_long.load(std::memory_order_relaxed)) {
+            if (varints_fit_64_bits(c->data.get(), end) && Parse(c->data.get(), end, values.data()) == end) {
+              const std::size_t n = num_varints({c->data.get(), c->size});
+              consume(c->sequence, std::span<const uint64_t>(values.data(), n));
+              self->varints += n;
+            } else {
+              std::size_t first = first_too_long.load(std::memory_order_relaxed);
+              while (c->sequence < first &&
+                     !first_too_long.compare_exchange_weak(first, c->sequence, std::memory_order_relaxed))
+                ;
+            }
+          }
+          self->free.push(c);
+        }
+      });
+    }
+
+    // the reader
+    char carry[16];
+    std::size_t carry_size = 0;
+    for (std::size_t sequence = 0;
+         result.ec == std::errc{} && first_too_long.load(std::memory_order_relaxed) == SIZE_MAX; ++sequence) {
+      auto &w = *workers[sequence % num_workers];
+      chunk *c = w.free.pop();
+      memcpy(c->data.get(), carry, carry_size);
+      std::size_t size = carry_size;
+      bool eof = false;
+      while (size < chunk_bytes) {
+        const ssize_t n = read(fd, c->data.get() + size, chunk_bytes - size);
+        if (n < 0 && errno == EINTR)
+          continue;
+        if (n < 0) {
+          result.ec = std::errc(errno);
+          break;
+        }
+        if (n == 0) {
+          eof = true;
+          break;
+        }
+        size += n;
+        result.bytes += n;
+      }
+
+      // cut after the last terminator
+      std::size_t end = size;
+      while (end > 0 && int8_t(c->data[end - 1]) < 0)
+        --end;
+      carry_size = size - end;
+      if (carry_size >= 10) {
+        result.ec = std::errc::value_too_large;
+        carry_size = 0;
+      }
+      memcpy(carry, c->data.get() + end, carry_size);
+      c->size = end;
+      c->sequence = sequence;
+      w.full.push(c);
+      if (eof) {
+        if (carry_size > 0 && result.ec == std::errc{})
+          result.ec = std::errc::invalid_argument;
+        break;
+      }
+    }
+
+    for (auto &w : workers)
+      w->full.push(nullptr);
+  }
+
+  for (auto &w : workers)
+    result.varints += w->varints;
+  // a chunk failing the check comes before any error of the reader
+  if (first_too_long.load() != SIZE_MAX)
+    result.ec = std::errc::value_too_large;
+  return result;
+}
+#endif
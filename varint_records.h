@@ -0,0 +1,56 @@
+#pragma once
+#include "checked_varint_parser.h"
+#include "parse_varint.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+// Framing of sequences of (varint length, bytes) records, such as the
+// elements of a repeated bytes or string field or the frames of a log,
+// without copying: each record is a std::string_view or
+// std::span<const char> into the buffer.
+//
+// A length prefix with 10 bytes of buffer after it is decoded with
+// shift_mix_parse_varint(), which needs no end checks; the last ones with
+// parse_checked_varint(). Where the next record starts is only known once the
+// length before it is decoded, so on buffers larger than the cache the loop
+// runs at the latency of a miss per record, which prefetching the next
+// record can't hide.
+
+// Appends the records of buffer to records; Record is constructed from the
+// pointer to and length of the bytes. On error, ptr is at the length prefix
+// of the malformed record, the records before it have been appended, and ec
+// is
+//   - std::errc::invalid_argument when the buffer ends inside the record;
+//   - std::errc::value_too_large for a length prefix longer than 10 bytes.
+template <typename Record = std::string_view>
+varint_parse_result parse_varint_records(std::span<const char> buffer, std::vector<Record> &records) {
+  const char *p = buffer.data();
+  const char *const end = buffer.data() + buffer.size();
+  while (p < end) {
+    uint64_t length;
+    const char *data;
+    if (end - p >= 10) [[likely]] {
+      int64_t v;
+      data = shift_mix_parse_varint<uint64_t>(p, v);
+      if (data == nullptr) [[unlikely]]
+        return {p, std::errc::value_too_large};
+      length = static_cast<uint64_t>(v);
+    } else {
+      const auto c = parse_checked_varint(p, end, length);
+      if (c.ec != std::errc{})
+        // a length past 64 bits is past the end of the buffer
+        return {p, c.ec == std::errc::result_out_of_range ? std::errc::invalid_argument : c.ec};
+      data = c.ptr;
+    }
+    if (length > static_cast<uint64_t>(end - data)) [[unlikely]]
+      return {p, std::errc::invalid_argument};
+    p = data + length;
+    records.emplace_back(data, static_cast<std::size_t>(length));
+  }
+  return {p, {}};
+}
@@ -0,0 +1,221 @@
+#pragma once
+#include "varint_parser.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <immintrin.h>
+#include <limits>
+#include <type_traits>
+
+// Reduction sinks for the bulk decoders, see varint_sink in varint_parser.h:
+//
+//   sum_varint_sink<> sum;
+//   ubfx_varint_parser::parse(begin, end, &sum);
+//
+// Values are taken as value_type, so a sink of int32_t behind
+// zigzag_varint_output sees negative values. The vector lanes are reduced into
+// accumulators in registers and folded when the result is asked for.
+
+#ifdef __AVX2__
+// the lanes of a vector from the decoders as 256 bits; the high half of a
+// 128-bit one is zero
+inline __m256i varint_sink_vector(__m256i v) { return v; }
+inline __m256i varint_sink_vector(__m128i v) { return _mm256_zextsi128_si256(v); }
+
+template <typename T>
+inline __m256i varint_lanes_splat(T v) {
+  if constexpr (sizeof(T) == 8)
+    return _mm256_set1_epi64x(static_cast<int64_t>(v));
+  else
+    return _mm256_set1_epi32(static_cast<int32_t>(v));
+}
+
+// all ones in the lanes below count
+template <typename T>
+inline __m256i varint_lanes_below(int count) {
+  if constexpr (sizeof(T) == 8)
+    return _mm256_cmpgt_epi64(_mm256_set1_epi64x(count), _mm256_setr_epi64x(0, 1, 2, 3));
+  else
+    return _mm256_cmpgt_epi32(_mm256_set1_epi32(count), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+}
+
+// all ones in the lanes where a > b, compared as T
+template <typename T>
+inline __m256i varint_lanes_greater(__m256i a, __m256i b) {
+  if constexpr (std::is_unsigned_v<T>) {
+    const __m256i bias = varint_lanes_splat<T>(T(1) << (sizeof(T) * 8 - 1));
+    a = _mm256_xor_si256(a, bias);
+    b = _mm256_xor_si256(b, bias);
+  }
+  if constexpr (sizeof(T) == 8)
+    return _mm256_cmpgt_epi64(a, b);
+  else
+    return _mm256_cmpgt_epi32(a, b);
+}
+
+template <typename T>
+inline std::array<T, 32 / sizeof(T)> varint_lanes_array(__m256i v) {
+  return std::bit_cast<std::array<T, 32 / sizeof(T)>>(v);
+}
+#endif
+
+// Number and sum of the values; the sum is taken modulo 2^64.
+template <typename T = uint64_t>
+struct sum_varint_sink {
+  using value_type = T;
+  using sum_type = std::conditional_t<std::is_signed_v<T>, int64_t, uint64_t>;
+
+  std::size_t count = 0;
+  uint64_t scalar_sum = 0; // unsigned, so that it wraps
+#ifdef __AVX2__
+  __m256i vector_sum = _mm256_setzero_si256(); // 64-bit lanes
+#endif
+
+  void operator()(uint64_t v) {
+    ++count;
+    scalar_sum += static_cast<uint64_t>(static_cast<sum_type>(static_cast<T>(v)));
+  }
+
+#ifdef __AVX2__
+  template <typename V>
+  void lanes(V v, int n) {
+    const __m256i w = _mm256_and_si256(varint_sink_vector(v), varint_lanes_below<T>(n));
+    count += n;
+    if constexpr (sizeof(T) == 8) {
+      vector_sum = _mm256_add_epi64(vector_sum, w);
+    } else {
+      const __m128i lo = _mm256_castsi256_si128(w), hi = _mm256_extracti128_si256(w, 1);
+      if constexpr (std::is_signed_v<T>)
+        vector_sum = _mm256_add_epi64(vector_sum, _mm256_add_epi64(_mm256_cvtepi32_epi64(lo), _mm256_cvtepi32_epi64(hi)));
+      else
+        vector_sum = _mm256_add_epi64(vector_sum, _mm256_add_epi64(_mm256_cvtepu32_epi64(lo), _mm256_cvtepu32_epi64(hi)));
+    }
+  }
+#endif
+
+  sum_type sum() const {
+    uint64_t result = scalar_sum;
+#ifdef __AVX2__
+    for (auto lane : varint_lanes_array<uint64_t>(vector_sum))
+      result += lane;
+#endif
+    return static_cast<sum_type>(result);
+  }
+};
+
+// Number, minimum and maximum of the values; with no values, the minimum is
+// the largest T and the maximum the smallest.
+template <typename T = uint64_t>
+struct min_max_varint_sink {
+  using value_type = T;
+
+  std::size_t count = 0;
+  T scalar_min = std::numeric_limits<T>::max();
+  T scalar_max = std::numeric_limits<T>::lowest();
+#ifdef __AVX2__
+  __m256i vector_min = varint_lanes_splat<T>(std::numeric_limits<T>::max());
+  __m256i vector_max = varint_lanes_splat<T>(std::numeric_limits<T>::lowest());
+#endif
+
+  void operator()(uint64_t v) {
+    ++count;
+    const auto x = static_cast<T>(v);
+    scalar_min = std::min(scalar_min, x);
+    scalar_max = std::max(scalar_max, x);
+  }
+
+#ifdef __AVX2__
+  template <typename V>
+  void lanes(V v, int n) {
+    const __m256i w = varint_sink_vector(v);
+    const __m256i valid = varint_lanes_below<T>(n);
+    count += n;
+    // the lanes past n are replaced with the identity of min and max
+    const __m256i lo = _mm256_blendv_epi8(varint_lanes_splat<T>(std::numeric_limits<T>::max()), w, valid);
+    const __m256i hi = _mm256_blendv_epi8(varint_lanes_splat<T>(std::numeric_limits<T>::lowest()), w, valid);
+    vector_min = _mm256_blendv_epi8(vector_min, lo, varint_lanes_greater<T>(vector_min, lo));
+    vector_max = _mm256_blendv_epi8(vector_max, hi, varint_lanes_greater<T>(hi, vector_max));
+  }
+#endif
+
+  T min() const {
+    T result = scalar_min;
+#ifdef __AVX2__
+    for (auto lane : varint_lanes_array<T>(vector_min))
+      result = std::min(result, lane);
+#endif
+    return result;
+  }
+
+  T max() const {
+    T result = scalar_max;
+#ifdef __AVX2__
+    for (auto lane : varint_lanes_array<T>(vector_max))
+      result = std::max(result, lane);
+#endif
+    return result;
+  }
+};
+
+// Histogram of the values by std::bit_width of their bits as an unsigned T:
+// counts[0] holds the zeros, counts[w] the values in [2^(w-1), 2^w).
+template <typename T = uint64_t>
+struct bit_width_histogram_varint_sink {
+  using value_type = T;
+  using unsigned_type = std::make_unsigned_t<T>;
+
+  std::array<std::size_t, sizeof(T) * 8 + 1> counts{};
+
+  void operator()(uint64_t v) { ++counts[std::bit_width(static_cast<unsigned_type>(v))]; }
+
+#ifdef __AVX2__
+  template <typename V>
+  void lanes(V v, int n) {
+    const auto values = varint_lanes_array<unsigned_type>(varint_sink_vector(v));
+    for (int i = 0; i < n; ++i)
+      ++counts[std::bit_width(values[i])];
+  }
+#endif
+
+  std::size_t total() const {
+    std::size_t n = 0;
+    for (auto c : counts)
+      n += c;
+    return n;
+  }
+};
+
+// Filter writing the selection vector of the values greater than threshold:
+// their ordinals, counting from 0, go to selection, which needs room for one
+// per value.
+template <typename T = uint64_t>
+struct greater_varint_sink {
+  using value_type = T;
+
+  T threshold;
+  uint32_t *selection;
+  uint32_t ordinal = 0;
+
+  greater_varint_sink(T threshold, uint32_t *selection) : threshold(threshold), selection(selection) {}
+
+  void operator()(uint64_t v) {
+    // stored unconditionally, kept only when selected
+    *selection = ordinal++;
+    selection += static_cast<T>(v) > threshold;
+  }
+
+#ifdef __AVX2__
+  template <typename V>
+  void lanes(V v, int n) {
+    const __m256i selected = _mm256_and_si256(
+        varint_lanes_greater<T>(varint_sink_vector(v), varint_lanes_splat<T>(threshold)), varint_lanes_below<T>(n));
+    unsigned bits = sizeof(T) == 8 ? _mm256_movemask_pd(_mm256_castsi256_pd(selected))
+                                   : _mm256_movemask_ps(_mm256_castsi256_ps(selected));
+    for (; bits != 0; bits &= bits - 1)
+      *selection++ = ordinal + std::countr_zero(bits);
+    ordinal += n;
+  }
+#endif
+};
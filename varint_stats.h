@@ -0,0 +1,45 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+// Slow path counters of the bulk decoders, compiled in with -DVARINT_STATS
+// and to nothing otherwise. They show how often the input leaves the fast
+// paths the benchmarks are tuned for.
+//
+// The kernels of varint_dispatch are compiled into namespaces of their own
+// (see varint_kernels.cpp) and so count into their own copy of these counters;
+// these only see the decoders instantiated in the calling code.
+struct varint_stats {
+  enum counter {
+    ubfx_long_varints, // 9 and 10 byte varints: the width == 9 path of ubfx_varint_parser
+    ubfx_tail_varints, // varints decoded by the tail loop of ubfx_varint_parser
+    bmi_tail_bytes,    // bytes decoded by the bytes_left loop of bmi_varint_parser
+    masked_vbyte_scalar_varints, // varints the tables of masked_vbyte_parser don't cover
+    masked_vbyte_tail_varints,   // varints decoded by the tail loop of masked_vbyte_parser
+    num_counters
+  };
+
+  static constexpr const char *names[num_counters] = {"ubfx_long_varints", "ubfx_tail_varints", "bmi_tail_bytes",
+                                                      "masked_vbyte_scalar_varints", "masked_vbyte_tail_varints"};
+
+#ifdef VARINT_STATS
+  static constexpr bool enabled = true;
+#else
+  static constexpr bool enabled = false;
+#endif
+
+  static inline std::array<std::atomic<uint64_t>, num_counters> counts{};
+
+  static inline void add(counter c, uint64_t n = 1) {
+    if constexpr (enabled)
+      counts[c].fetch_add(n, std::memory_order_relaxed);
+  }
+
+  static uint64_t get(counter c) { return counts[c].load(std::memory_order_relaxed); }
+
+  static void reset() {
+    for (auto &count : counts)
+      count.store(0, std::memory_order_relaxed);
+  }
+};
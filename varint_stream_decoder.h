@@ -0,0 +1,104 @@
+#pragma once
+#include "checked_varint_parser.h"
+#include "num_varints.h"
+#include "varint_parser.h"
+
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <system_error>
+#include <utility>
+
+// Returns the position right after the last of at most max_count varint
+// terminators in [begin, end) and the number of terminators before it.
+inline std::pair<const char *, std::size_t> find_varint_terminators(const char *begin, const char *end,
+                                                                    std::size_t max_count) {
+  return skip_varints(begin, end, max_count);
+}
+
+// Decoder for varint streams received in arbitrary chunks.
+//
+// Each call to decode() consumes as much of a chunk as fits in the output. A
+// varint split across chunks is accumulated in the decoder, so chunks are never
+// copied into a staging buffer; runs of complete varints are handed to the
+// Parse bulk kernel as they are, once varints_fit_64_bits() has checked them.
+template <typename T, auto Parse = &ubfx_varint_parser::parse<T>>
+class varint_stream_decoder {
+  uint64_t pt_val = 0;
+  int shift_bits = 0;
+
+  // returns false when the pending varint is longer than 10 bytes
+  bool append(char c) {
+    if (shift_bits >= 70)
+      return false;
+    pt_val |= (uint64_t(c) & 0x7fULL) << shift_bits;
+    shift_bits += CHAR_BIT - 1;
+    return true;
+  }
+
+public:
+  // true when a varint was cut off by the end of the last chunk
+  bool has_partial() const { return shift_bits != 0; }
+
+  void reset() {
+    pt_val = 0;
+    shift_bits = 0;
+  }
+
+  // Decodes varints from input into output and advances both spans past what
+  // was consumed and produced. Stops when input is exhausted or output is
+  // full; the bytes of a trailing incomplete varint are always consumed.
+  // Returns std::errc::value_too_large when a varint carried across chunks
+  // grows past 10 bytes, with input positioned at the offending byte, or when a
+  // varint within the chunk is longer than 10 bytes or overflows 64 bits, with
+  // input positioned at its first byte and the varints before it decoded.
+  std::errc decode(std::span<const char> &input, std::span<T> &output) {
+    auto p = input.data();
+    auto end = p + input.size();
+    auto out = output.data();
+    auto out_end = out + output.size();
+    const auto done = [&](std::errc ec) {
+      input = std::span<const char>(p, end);
+      output = std::span<T>(out, out_end);
+      return ec;
+    };
+
+    // finish the varint carried over from the previous chunk
+    for (; has_partial() && p < end && out < out_end; ++p) {
+      if (!append(*p)) [[unlikely]]
+        return done(std::errc::value_too_large);
+      if (int8_t(*p) >= 0) {
+        *out++ = static_cast<T>(pt_val);
+        reset();
+      }
+    }
+
+    if (!has_partial()) {
+      auto [complete, count] = find_varint_terminators(p, end, out_end - out);
+      if (count > 0) {
+        if (!varints_fit_64_bits(p, complete)) [[unlikely]] {
+          for (;;) {
+            uint64_t value;
+            const auto r = parse_checked_varint(p, complete, value);
+            if (r.ec != std::errc{})
+              return done(std::errc::value_too_large);
+            *out++ = static_cast<T>(value);
+            p = r.ptr;
+          }
+        }
+        Parse(p, complete, out);
+        out += count;
+        p = complete;
+      }
+      if (out < out_end) {
+        // the rest is the beginning of a varint completed by the next chunk
+        for (; p < end; ++p) {
+          if (!append(*p)) [[unlikely]]
+            return done(std::errc::value_too_large);
+        }
+      }
+    }
+    return done({});
+  }
+};